@@ -0,0 +1,209 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ *
+ * Domain context switch round-trip benchmark.
+ *
+ * The payload is booted as two domain instances on the same HART:
+ *  - The TEE domain instance referred by the "riscv,sbi-rpxy-tee" node,
+ *    with "next-arg1 = <0x0 0x54454542>", assigned to the HART so that
+ *    it boots first and registers its entry vectors with the SPD.
+ *  - The "untrusted-domain" instance, booted when the TEE domain exits,
+ *    which measures COMMUNICATE (fast call) to COMPLETE round trips
+ *    and direct fast call round trips.
+ * Both domain instances need read/write access to the payload region.
+ * The "context-isolation" property of the domains selects the state
+ * switched on each round trip.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_string.h>
+
+#define CTXBENCH_ITERATIONS		1000
+#define CTXBENCH_SHMEM_SIZE		0x1000
+
+/* RPXY transport, service group and services of the SPD */
+#define SPD_TRANSPORT_ID		(1UL << 16)
+#define SPD_SRVGRP_BASE			0x1
+#define SPD_SRV_COMMUNICATE		0x1
+#define SPD_SRV_COMPLETE		0x2
+#define SPD_RETURN_INIT_DONE		0xBE000000UL
+#define SPD_FUNCID_FAST			(1UL << 31)
+
+/* SPD direct call extension */
+#define SBI_EXT_SPD_DIRECT		0x0A535044
+#define SPD_DIRECT_FID_FAST_CALL	0
+
+/* Length of a request/reply (function ID and four arguments) */
+#define SPD_MSG_LEN			(5 * sizeof(unsigned long))
+
+struct sbiret {
+	unsigned long error;
+	unsigned long value;
+};
+
+extern char ctxbench_tee_vectors[];
+extern char ctxbench_tee_direct_entry[];
+
+enum ctxbench_mode {
+	CTXBENCH_RPXY = 0,
+	CTXBENCH_RPXY_FP_DIRTY,
+	CTXBENCH_DIRECT,
+};
+
+/* Shared memory of the untrusted (0) and TEE (1) domains */
+static char ctxbench_shmem[2][CTXBENCH_SHMEM_SIZE]
+	__aligned(CTXBENCH_SHMEM_SIZE);
+
+static struct sbiret sbi_ecall(int ext, int fid, unsigned long arg0,
+			       unsigned long arg1, unsigned long arg2,
+			       unsigned long arg3)
+{
+	struct sbiret ret;
+
+	register unsigned long a0 asm ("a0") = (unsigned long)(arg0);
+	register unsigned long a1 asm ("a1") = (unsigned long)(arg1);
+	register unsigned long a2 asm ("a2") = (unsigned long)(arg2);
+	register unsigned long a3 asm ("a3") = (unsigned long)(arg3);
+	register unsigned long a6 asm ("a6") = (unsigned long)(fid);
+	register unsigned long a7 asm ("a7") = (unsigned long)(ext);
+	asm volatile ("ecall"
+		      : "+r" (a0), "+r" (a1)
+		      : "r" (a2), "r" (a3), "r" (a6), "r" (a7)
+		      : "memory");
+	ret.error = a0;
+	ret.value = a1;
+
+	return ret;
+}
+
+static void ctxbench_puts(const char *str)
+{
+	sbi_ecall(SBI_EXT_DBCN, SBI_EXT_DBCN_CONSOLE_WRITE,
+		  sbi_strlen(str), (unsigned long)str, 0, 0);
+}
+
+static void ctxbench_put_ulong(unsigned long val)
+{
+	char buf[3 * sizeof(unsigned long) + 1];
+	int pos = sizeof(buf) - 1;
+
+	buf[pos] = '\0';
+	do {
+		buf[--pos] = '0' + (val % 10);
+		val /= 10;
+	} while (val);
+
+	ctxbench_puts(&buf[pos]);
+}
+
+static struct sbiret spd_send(unsigned long service_id, unsigned long len)
+{
+	return sbi_ecall(SBI_EXT_RPXY, SBI_EXT_RPXY_SEND_NORMAL_MESSAGE,
+			 SPD_TRANSPORT_ID, SPD_SRVGRP_BASE, service_id, len);
+}
+
+static int spd_set_shmem(void *shmem)
+{
+	return sbi_ecall(SBI_EXT_RPXY, SBI_EXT_RPXY_SET_SHMEM,
+			 CTXBENCH_SHMEM_SIZE, (unsigned long)shmem, 0, 0).error;
+}
+
+/* Leave the FP state Dirty as a supervisor using FP would */
+static void ctxbench_dirty_fp(unsigned long val)
+{
+#ifdef __riscv_flen
+	__asm__ __volatile__("fcvt.d.w f0, %0\n"
+			     "fcvt.d.w f31, %0" : : "r"(val));
+#endif
+}
+
+static void ctxbench_run(const char *name, enum ctxbench_mode mode)
+{
+	unsigned long *msg = (unsigned long *)ctxbench_shmem[0];
+	unsigned long i, start, delta, total = 0, min = -1UL, max = 0;
+	struct sbiret ret;
+
+	for (i = 0; i < CTXBENCH_ITERATIONS; i++) {
+		if (mode == CTXBENCH_RPXY_FP_DIRTY)
+			ctxbench_dirty_fp(i);
+
+		msg[0] = SPD_FUNCID_FAST;
+		start = csr_read(CSR_TIME);
+		if (mode == CTXBENCH_DIRECT) {
+			ret = sbi_ecall(SBI_EXT_SPD_DIRECT,
+					SPD_DIRECT_FID_FAST_CALL,
+					SPD_FUNCID_FAST, i, 0, 0);
+			/* The TEE returns the call as results */
+			if (ret.error == SPD_FUNCID_FAST && ret.value == i)
+				ret.error = 0;
+		} else {
+			ret = spd_send(SPD_SRV_COMMUNICATE, SPD_MSG_LEN);
+		}
+		delta = csr_read(CSR_TIME) - start;
+		if (ret.error) {
+			ctxbench_puts("ctxbench: ");
+			ctxbench_puts(name);
+			ctxbench_puts(" call failed\n");
+			return;
+		}
+
+		total += delta;
+		if (delta < min)
+			min = delta;
+		if (delta > max)
+			max = delta;
+	}
+
+	ctxbench_puts("ctxbench: ");
+	ctxbench_puts(name);
+	ctxbench_puts(": min ");
+	ctxbench_put_ulong(min);
+	ctxbench_puts(" avg ");
+	ctxbench_put_ulong(total / CTXBENCH_ITERATIONS);
+	ctxbench_puts(" max ");
+	ctxbench_put_ulong(max);
+	ctxbench_puts(" timer ticks per round trip\n");
+}
+
+void ctxbench_main(unsigned long a0, unsigned long a1)
+{
+	ctxbench_puts("\nDomain context round-trip benchmark\n");
+
+	if (spd_set_shmem(ctxbench_shmem[0])) {
+		ctxbench_puts("ctxbench: failed to set shared memory\n");
+		return;
+	}
+
+	ctxbench_run("rpxy", CTXBENCH_RPXY);
+	ctxbench_run("direct", CTXBENCH_DIRECT);
+
+#ifdef __riscv_flen
+	csr_set(CSR_SSTATUS, SSTATUS_FS);
+	if (csr_read(CSR_SSTATUS) & SSTATUS_FS)
+		ctxbench_run("rpxy-fp-dirty", CTXBENCH_RPXY_FP_DIRTY);
+#endif
+}
+
+void ctxbench_tee_main(unsigned long a0, unsigned long a1)
+{
+	unsigned long *msg = (unsigned long *)ctxbench_shmem[1];
+
+	if (spd_set_shmem(msg))
+		return;
+
+	/* Register the entry vectors and hand over to the next domain */
+	msg[0] = SPD_RETURN_INIT_DONE;
+	msg[1] = (unsigned long)ctxbench_tee_vectors;
+	msg[2] = (unsigned long)ctxbench_tee_direct_entry;
+	spd_send(SPD_SRV_COMPLETE, 3 * sizeof(unsigned long));
+}
+
+void ctxbench_tee_entry(void)
+{
+	/* Reply right away with the request arguments */
+	spd_send(SPD_SRV_COMPLETE, SPD_MSG_LEN);
+}
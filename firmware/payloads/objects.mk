@@ -17,3 +17,14 @@ test-y += test_main.o
 
 %/test.dep: $(foreach dep,$(test-y:.o=.dep),%/$(dep))
 	$(call merge_deps,$@,$^)
+
+firmware-bins-$(FW_PAYLOAD) += payloads/ctxbench.bin
+
+ctxbench-y += ctxbench_head.o
+ctxbench-y += ctxbench_main.o
+
+%/ctxbench.o: $(foreach obj,$(ctxbench-y),%/$(obj))
+	$(call merge_objs,$@,$^)
+
+%/ctxbench.dep: $(foreach dep,$(ctxbench-y:.o=.dep),%/$(dep))
+	$(call merge_deps,$@,$^)
@@ -157,6 +157,12 @@ void csr_write_num(int csr_num, unsigned long val);
 		__asm__ __volatile__("wfi" ::: "memory"); \
 	} while (0)
 
+/* Zihintpause PAUSE, executes as a FENCE hint without Zihintpause */
+#define pause()                                                   \
+	do {                                                      \
+		__asm__ __volatile__(".word 0x0100000f" ::: "memory"); \
+	} while (0)
+
 #define ebreak()                                             \
 	do {                                              \
 		__asm__ __volatile__("ebreak" ::: "memory"); \
@@ -187,6 +193,10 @@ int pmp_disable(unsigned int n);
 /* Check if the matching field is set */
 int is_pmp_entry_mapped(unsigned long entry);
 
+/* Encode pmpcfg byte and pmpaddr value of a NA4/NAPOT entry */
+int pmp_encode(unsigned long prot, unsigned long addr, unsigned long log2len,
+	       unsigned long *cfg_out, unsigned long *addr_out);
+
 int pmp_set(unsigned int n, unsigned long prot, unsigned long addr,
 	    unsigned long log2len);
 
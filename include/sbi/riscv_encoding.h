@@ -26,6 +26,8 @@
 #define MSTATUS_FS			_UL(0x00006000)
 #define MSTATUS_XS			_UL(0x00018000)
 #define MSTATUS_VS			_UL(0x00000600)
+#define MSTATUS_FS_INITIAL		_UL(0x00002000)
+#define MSTATUS_VS_INITIAL		_UL(0x00000200)
 #define MSTATUS_MPRV			_UL(0x00020000)
 #define MSTATUS_SUM			_UL(0x00040000)
 #define MSTATUS_MXR			_UL(0x00080000)
@@ -238,6 +240,15 @@
 #define CSR_FRM				0x002
 #define CSR_FCSR			0x003
 
+/* User Vector CSRs */
+#define CSR_VSTART			0x008
+#define CSR_VXSAT			0x009
+#define CSR_VXRM			0x00a
+#define CSR_VCSR			0x00f
+#define CSR_VL				0xc20
+#define CSR_VTYPE			0xc21
+#define CSR_VLENB			0xc22
+
 /* User Counters/Timers */
 #define CSR_CYCLE			0xc00
 #define CSR_TIME			0xc01
@@ -394,6 +405,10 @@
 #define CSR_VSIP			0x244
 #define CSR_VSATP			0x280
 
+/* Sstc extension */
+#define CSR_VSTIMECMP			0x24D
+#define CSR_VSTIMECMPH			0x25D
+
 /* Virtual Interrupts and Interrupt Priorities (H-extension with AIA) */
 #define CSR_HVIEN			0x608
 #define CSR_HVICTL			0x609
@@ -862,6 +877,10 @@
 #define INSN_MASK_FENCE_TSO		0xffffffff
 #define INSN_MATCH_FENCE_TSO		0x8330000f
 
+#define INSN_MASK_WRS			0xffffffff
+#define INSN_MATCH_WRS_NTO		0x00d00073
+#define INSN_MATCH_WRS_STO		0x01d00073
+
 #if __riscv_xlen == 64
 
 /* 64-bit read for VS-stage address translation (RV64) */
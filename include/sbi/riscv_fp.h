@@ -102,6 +102,12 @@
 #define GET_F64_RS2C(insn, regs) (GET_F64_REG(insn, 2, regs))
 #define GET_F64_RS2S(insn, regs) (GET_F64_REG(RVC_RS2S(insn), 0, regs))
 
+/** Save f0-f31 to an array of 32 doublewords */
+void __sbi_fp_save(u64 *f);
+
+/** Restore f0-f31 from an array of 32 doublewords */
+void __sbi_fp_restore(const u64 *f);
+
 #endif
 
 #endif
@@ -10,6 +10,87 @@
 
 #include <sbi/sbi_types.h>
 
+/** Queue node of a HART waiting for or holding a queued spinlock */
+struct qspin_node {
+	struct qspin_node *next;
+	volatile u32 locked;
+};
+
+/** Contention statistics of a queued spinlock */
+struct qspin_lock_stats {
+	const char *name;
+	unsigned long acquisitions;
+	unsigned long contended;
+	unsigned long spins;
+	unsigned long max_wait_cycles;
+	/** Failed trylock attempts (updated without holding the lock) */
+	unsigned long trylock_failed;
+};
+
+/**
+ * MCS style queued spinlock
+ *
+ * Each waiter spins on the node of its own HART, placed in its scratch
+ * space, instead of all waiters spinning on the lock word. A HART with
+ * all its nodes in use falls back to test-and-set of the lock word with
+ * the node embedded in the lock.
+ */
+typedef struct {
+	struct qspin_node *tail;
+	struct qspin_node *owner;
+	/** Node used by a HART having all its own nodes in use */
+	struct qspin_node fallback;
+#ifdef CONFIG_SBI_SPINLOCK_STATS
+	struct qspin_lock_stats stats;
+#endif
+} qspinlock_t;
+
+#define __QSPIN_LOCK_UNLOCKED	\
+	(qspinlock_t) { .tail = NULL, .owner = NULL }
+
+#define QSPIN_LOCK_INIT(x)	\
+	x = __QSPIN_LOCK_UNLOCKED
+
+#define QSPIN_LOCK_INITIALIZER	\
+	__QSPIN_LOCK_UNLOCKED
+
+#define DEFINE_QSPIN_LOCK(x)	\
+	qspinlock_t QSPIN_LOCK_INIT(x)
+
+bool qspin_lock_check(qspinlock_t *lock);
+
+bool qspin_trylock(qspinlock_t *lock);
+
+void qspin_lock(qspinlock_t *lock);
+
+void qspin_unlock(qspinlock_t *lock);
+
+#ifdef CONFIG_SBI_SPINLOCK_STATS
+
+/** Add a queued spinlock to the locks printed by qspin_lock_stats_dump() */
+void qspin_lock_stats_register(qspinlock_t *lock, const char *name);
+
+/** Print contention statistics of registered queued spinlocks */
+void qspin_lock_stats_dump(void);
+
+#else
+
+static inline void qspin_lock_stats_register(qspinlock_t *lock,
+					     const char *name) { }
+
+static inline void qspin_lock_stats_dump(void) { }
+
+#endif
+
+#ifdef CONFIG_SBI_SPINLOCK_QUEUED
+
+typedef qspinlock_t spinlock_t;
+
+#define __SPIN_LOCK_UNLOCKED	\
+	__QSPIN_LOCK_UNLOCKED
+
+#else
+
 #define TICKET_SHIFT	16
 
 typedef struct {
@@ -25,6 +106,8 @@ typedef struct {
 #define __SPIN_LOCK_UNLOCKED	\
 	(spinlock_t) { 0, 0 }
 
+#endif
+
 #define SPIN_LOCK_INIT(x)	\
 	x = __SPIN_LOCK_UNLOCKED
 
@@ -24,6 +24,9 @@ struct sbi_console_device {
 
 	/** Read a character from the console input */
 	int (*console_getc)(void);
+
+	/** Write out console output buffered by the device (optional) */
+	void (*console_flush)(void);
 };
 
 #define __printf(a, b) __attribute__((format(printf, a, b)))
@@ -60,6 +63,33 @@ struct sbi_scratch;
 
 int sbi_console_init(struct sbi_scratch *scratch);
 
+#ifdef CONFIG_SBI_CONSOLE_BUFFERED
+
+/** Size of the console ring of each HART (power of 2) */
+#define SBI_CONSOLE_RING_SIZE		1024
+
+/** Heap space taken by the console ring of each HART */
+#define SBI_CONSOLE_RING_HEAP_SIZE	(SBI_CONSOLE_RING_SIZE + 128)
+
+/** Queue firmware messages in per-HART rings from now on */
+void sbi_console_buffer_enable(void);
+
+/** Write pending messages unless another HART is already doing it */
+void sbi_console_drain(void);
+
+#else
+
+#define SBI_CONSOLE_RING_HEAP_SIZE	0
+
+static inline void sbi_console_buffer_enable(void) { }
+
+static inline void sbi_console_drain(void) { }
+
+#endif
+
+/** Write all pending messages, including those buffered by the device */
+void sbi_console_flush(void);
+
 #define SBI_ASSERT(cond, args) do { \
 	if (unlikely(!(cond))) \
 		sbi_panic args; \
@@ -161,6 +161,15 @@ struct sbi_domain_memregion {
 /** Maximum number of domains */
 #define SBI_DOMAIN_MAX_INDEX			32
 
+struct sbi_domain_region_range;
+
+/** Domain context switches isolate floating-point state */
+#define SBI_DOMAIN_CTX_ISOLATE_FP		(1UL << 0)
+/** Domain context switches isolate vector state */
+#define SBI_DOMAIN_CTX_ISOLATE_VECTOR		(1UL << 1)
+/** Domain context switches isolate hypervisor and VS-level CSRs */
+#define SBI_DOMAIN_CTX_ISOLATE_HYP		(1UL << 2)
+
 /** Representation of OpenSBI domain */
 struct sbi_domain {
 	/**
@@ -184,6 +193,14 @@ struct sbi_domain {
 	struct rpxy_state *hartindex_to_rs_table[SBI_HARTMASK_MAX_BITS];
 	/** Array of memory regions terminated by a region with order zero */
 	struct sbi_domain_memregion *regions;
+	/**
+	 * Address ranges sorted by start, each resolved to its first
+	 * matching region
+	 * Note: This set by sbi_domain_finalize() in the coldboot path
+	 */
+	struct sbi_domain_region_range *region_index;
+	/** Number of entries in region_index */
+	u32 region_index_count;
 	/** HART id of the HART booting this domain */
 	u32 boot_hartid;
 	/** Arg1 (or 'a1' register) of next booting stage for this domain */
@@ -192,6 +209,8 @@ struct sbi_domain {
 	unsigned long next_addr;
 	/** Privilege mode of next booting stage for this domain */
 	unsigned long next_mode;
+	/** State classes isolated on domain context switches */
+	unsigned long context_flags;
 	/** Is domain allowed to reset the system */
 	bool system_reset_allowed;
 	/** Is domain allowed to suspend the system */
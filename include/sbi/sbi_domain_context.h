@@ -10,6 +10,63 @@
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_domain.h>
+#include <sbi/sbi_hart.h>
+
+/** Floating-point state of a hart within a domain */
+struct sbi_context_fp {
+	/** Floating-point registers f0-f31 */
+	u64 f[32];
+	/** Floating-point control and status register */
+	unsigned long fcsr;
+};
+
+/** Vector state of a hart within a domain */
+struct sbi_context_vector {
+	/** Vector start index register */
+	unsigned long vstart;
+	/** Vector control and status register */
+	unsigned long vcsr;
+	/** Vector length register */
+	unsigned long vl;
+	/** Vector data type register */
+	unsigned long vtype;
+	/** Vector registers v0-v31 (32 * vlenb bytes) */
+	u8 v[];
+};
+
+/** Hypervisor and VS-level state of a hart within a domain */
+struct sbi_context_hyp {
+	unsigned long hstatus;
+	unsigned long hedeleg;
+	unsigned long hideleg;
+	unsigned long hie;
+	unsigned long hvip;
+	unsigned long hcounteren;
+	unsigned long hgeie;
+	unsigned long htval;
+	unsigned long htinst;
+	unsigned long hgatp;
+	u64 htimedelta;
+	u64 henvcfg;
+	/** Present only with Smstateen */
+	u64 hstateen[SMSTATEEN_MAX_COUNT];
+	/** Present only with Smaia */
+	unsigned long hvien;
+	unsigned long hvictl;
+	u64 hviprio1;
+	u64 hviprio2;
+	/** Present only with Sstc */
+	u64 vstimecmp;
+	unsigned long vsstatus;
+	unsigned long vsie;
+	unsigned long vstvec;
+	unsigned long vsscratch;
+	unsigned long vsepc;
+	unsigned long vscause;
+	unsigned long vstval;
+	unsigned long vsip;
+	unsigned long vsatp;
+};
 
 /** Context representation for a hart within a domain */
 struct sbi_context {
@@ -39,8 +96,20 @@ struct sbi_context {
 	/** Supervisor environment configuration register */
 	unsigned long senvcfg;
 
+	/** Floating-point state (SBI_DOMAIN_CTX_ISOLATE_FP) */
+	struct sbi_context_fp fp;
+	/** Vector state (SBI_DOMAIN_CTX_ISOLATE_VECTOR, allocated on first use) */
+	struct sbi_context_vector *vector;
+	/** Hypervisor state (SBI_DOMAIN_CTX_ISOLATE_HYP) */
+	struct sbi_context_hyp hyp;
+
+	/** PMP image of the domain on this HART (built on first switch) */
+	struct sbi_hart_pmp_image *pmp;
+
 	/** Reference to the owning domain */
 	struct sbi_domain *dom;
+	/** HART index of the context */
+	u32 hartindex;
 	/** Previous context (caller) to jump to during context exits */
 	struct sbi_context *prev_ctx;
 	/** Is context initialized and runnable */
@@ -75,6 +144,17 @@ int sbi_domain_context_set_mepc(struct sbi_domain *dom, unsigned long entry_poin
  */
 int sbi_domain_context_enter(struct sbi_domain *dom);
 
+/**
+ * Enter a domain context synchronously given the contexts of the calling
+ * HART, without the lookups of sbi_domain_context_enter()
+ * @param ctx context of the calling HART in its current domain
+ * @param dom_ctx context of the calling HART in the target domain
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_domain_context_enter_ctx(struct sbi_context *ctx,
+				 struct sbi_context *dom_ctx);
+
 /**
  * Exit the current domain context, and then return to the caller
  * of sbi_domain_context_enter or attempt to start the next domain
@@ -84,6 +164,15 @@ int sbi_domain_context_enter(struct sbi_domain *dom);
  */
 int sbi_domain_context_exit(void);
 
+/**
+ * Exit a domain context of the calling HART, same as
+ * sbi_domain_context_exit() for a known current context
+ * @param ctx context of the calling HART in its current domain
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_domain_context_exit_ctx(struct sbi_context *ctx);
+
 /** Initialize contexts for all domains */
 int sbi_domain_context_init(struct sbi_scratch *scratch);
 
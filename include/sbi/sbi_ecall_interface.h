@@ -312,6 +312,19 @@ enum sbi_cppc_reg_id {
 #define SBI_EXT_RPXY_SEND_POSTED_MESSAGE	0x3
 #define SBI_EXT_RPXY_GET_NOTIFICATION_EVENTS	0x4
 
+/*
+ * OpenSBI specific extension (firmware specific extension space) to read
+ * firmware statistics and dump debug state. Only the root domain may use it.
+ */
+#define SBI_EXT_FWDBG				0x0A444247
+
+/* SBI function IDs for the firmware debug extension */
+#define SBI_EXT_FWDBG_HSM_IDLE_STAT		0x0
+#define SBI_EXT_FWDBG_HSM_IDLE_STAT_HI		0x1
+#define SBI_EXT_FWDBG_HEAP_STAT			0x2
+#define SBI_EXT_FWDBG_LOCK_STAT_DUMP		0x3
+#define SBI_EXT_FWDBG_TRACE_DUMP		0x4
+
 /* SBI base specification related macros */
 #define SBI_SPEC_VERSION_MAJOR_OFFSET		24
 #define SBI_SPEC_VERSION_MAJOR_MASK		0x7f
@@ -10,6 +10,7 @@
 #ifndef __SBI_HART_H__
 #define __SBI_HART_H__
 
+#include <sbi/riscv_encoding.h>
 #include <sbi/sbi_types.h>
 #include <sbi/sbi_bitops.h>
 
@@ -63,6 +64,8 @@ enum sbi_hart_extensions {
 	SBI_HART_EXT_SSCSRIND,
 	/** Hart has Ssccfg extension */
 	SBI_HART_EXT_SSCCFG,
+	/** Hart has Zawrs extension */
+	SBI_HART_EXT_ZAWRS,
 
 	/** Maximum index of Hart extension */
 	SBI_HART_EXT_MAX,
@@ -101,6 +104,16 @@ struct sbi_hart_features {
 	unsigned int mhpm_bits;
 };
 
+/** Number of PMP entries covered by one pmpcfg CSR */
+#define SBI_HART_PMPCFG_ENTRIES		(__riscv_xlen / 8)
+
+/** PMP CSR image of a domain on a HART */
+struct sbi_hart_pmp_image {
+	unsigned long pmpcfg[PMP_COUNT / SBI_HART_PMPCFG_ENTRIES];
+	unsigned long pmpaddr[PMP_COUNT];
+};
+
+struct sbi_domain;
 struct sbi_scratch;
 
 int sbi_hart_reinit(struct sbi_scratch *scratch);
@@ -120,6 +133,11 @@ unsigned int sbi_hart_pmp_log2gran(struct sbi_scratch *scratch);
 unsigned int sbi_hart_pmp_addrbits(struct sbi_scratch *scratch);
 unsigned int sbi_hart_mhpm_bits(struct sbi_scratch *scratch);
 int sbi_hart_pmp_configure(struct sbi_scratch *scratch);
+int sbi_hart_pmp_image_build(struct sbi_scratch *scratch,
+			     struct sbi_domain *dom,
+			     struct sbi_hart_pmp_image *img);
+void sbi_hart_pmp_image_load(struct sbi_scratch *scratch,
+			     const struct sbi_hart_pmp_image *img);
 int sbi_hart_map_saddr(unsigned long base, unsigned long size);
 int sbi_hart_unmap_saddr(void);
 int sbi_hart_priv_version(struct sbi_scratch *scratch);
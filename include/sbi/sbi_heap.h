@@ -15,6 +15,33 @@
 /* Alignment of heap base address and size */
 #define HEAP_BASE_ALIGN			1024
 
+/* Number of slab size classes cached by each HART */
+#define SBI_HEAP_SLAB_CLASSES		3
+
+/* Heap space each HART may keep in cached slabs */
+#define SBI_HEAP_HART_CACHE_SIZE	(SBI_HEAP_SLAB_CLASSES * HEAP_BASE_ALIGN)
+
+/** Heap statistics */
+enum sbi_heap_stat {
+	/** Total size of the heap area */
+	SBI_HEAP_STAT_TOTAL = 0,
+	/** Space reserved for heap housekeeping */
+	SBI_HEAP_STAT_RESERVED,
+	/** Space currently in use */
+	SBI_HEAP_STAT_USED,
+	/** Space currently free */
+	SBI_HEAP_STAT_FREE,
+	/** Highest space ever in use */
+	SBI_HEAP_STAT_PEAK,
+	/** Size of the largest free block */
+	SBI_HEAP_STAT_LARGEST_FREE,
+	/** Number of free blocks */
+	SBI_HEAP_STAT_FREE_BLOCKS,
+	/** Number of failed allocations */
+	SBI_HEAP_STAT_FAILED_ALLOCS,
+	SBI_HEAP_STAT_MAX,
+};
+
 struct sbi_scratch;
 
 /** Allocate from heap area */
@@ -41,6 +68,27 @@ unsigned long sbi_heap_used_space(void);
 /** Amount (in bytes) of reserved space in the heap area */
 unsigned long sbi_heap_reserved_space(void);
 
+/**
+ * Read a heap statistic
+ *
+ * @param stat statistic to read (enum sbi_heap_stat)
+ * @param out_val output statistic value
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_heap_get_stat(u32 stat, unsigned long *out_val);
+
+/**
+ * Mark current HART as stopped or suspended. Objects queued for it by
+ * other HARTs are freed, and later frees go straight to its slabs.
+ */
+void sbi_heap_hart_offline(void);
+
+/** Mark current HART as running again */
+void sbi_heap_hart_online(void);
+
+/** Print heap allocations of each call site (if tracked) */
+void sbi_heap_dump_callers(void);
+
 /** Initialize heap area */
 int sbi_heap_init(struct sbi_scratch *scratch);
 
@@ -0,0 +1,126 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#ifndef __SBI_HSM_IDLE_H__
+#define __SBI_HSM_IDLE_H__
+
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+/** Description of a CPU idle (HSM suspend) state */
+struct sbi_cpu_idle_state {
+	/** Name of the idle state (NULL terminates a state table) */
+	const char *name;
+	/** HSM suspend type used to enter the idle state */
+	uint32_t suspend_param;
+	/** Local timer stops while in the idle state */
+	bool local_timer_stop;
+	/** Worst case latency to enter the idle state */
+	uint32_t entry_latency_us;
+	/** Worst case latency to exit the idle state */
+	uint32_t exit_latency_us;
+	/** Minimum residency for the idle state to be worthwhile */
+	uint32_t min_residency_us;
+	/** Worst case wakeup latency of the idle state */
+	uint32_t wakeup_latency_us;
+};
+
+/** Per-state statistics kept by the HSM idle governor */
+enum sbi_hsm_idle_stat {
+	/** Number of times the state was entered */
+	SBI_HSM_IDLE_STAT_USAGE = 0,
+	/** Total time spent in the state */
+	SBI_HSM_IDLE_STAT_RESIDENCY_US,
+	/** Exits after at least the minimum residency */
+	SBI_HSM_IDLE_STAT_HITS,
+	/** Exits before the minimum residency */
+	SBI_HSM_IDLE_STAT_MISSES,
+	/** Entries in place of a deeper requested state */
+	SBI_HSM_IDLE_STAT_DEMOTED,
+	/** Entries in place of a shallower requested state */
+	SBI_HSM_IDLE_STAT_PROMOTED,
+	SBI_HSM_IDLE_STAT_MAX,
+};
+
+struct sbi_scratch;
+
+#ifdef CONFIG_SBI_HSM_IDLE_GOVERNOR
+
+/**
+ * Register the idle states of the platform
+ *
+ * Must be called on the cold boot path after heap initialization. Only
+ * the first registered table is used.
+ *
+ * @param states array of idle states, ending with empty element
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_hsm_idle_set_states(const struct sbi_cpu_idle_state *states);
+
+/** Get the registered idle states (NULL if none) */
+const struct sbi_cpu_idle_state *sbi_hsm_idle_get_states(void);
+
+/**
+ * Select the suspend type to enter for a HSM suspend request
+ *
+ * @param scratch scratch space of current HART
+ * @param suspend_type suspend type requested by the supervisor
+ * @return suspend type to be passed to the HSM device
+ */
+u32 sbi_hsm_idle_select(struct sbi_scratch *scratch, u32 suspend_type);
+
+/** Account the exit from the idle state selected for current HART */
+void sbi_hsm_idle_exit(struct sbi_scratch *scratch);
+
+/**
+ * Read an idle statistic of a HART
+ *
+ * State index equal to the number of registered states refers to the
+ * default retentive suspend (WFI) when it is not part of the table.
+ *
+ * @param hartid HART to query
+ * @param state index of the idle state
+ * @param stat statistic to read (enum sbi_hsm_idle_stat)
+ * @param out_val output statistic value
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_hsm_idle_get_stat(u32 hartid, u32 state, u32 stat, u64 *out_val);
+
+/** Enable the HSM idle test device and idle states */
+void sbi_hsm_idle_test_enable(void);
+
+#else
+
+static inline int sbi_hsm_idle_set_states(
+				const struct sbi_cpu_idle_state *states)
+{
+	return 0;
+}
+
+static inline const struct sbi_cpu_idle_state *sbi_hsm_idle_get_states(void)
+{
+	return NULL;
+}
+
+static inline u32 sbi_hsm_idle_select(struct sbi_scratch *scratch,
+				      u32 suspend_type)
+{
+	return suspend_type;
+}
+
+static inline void sbi_hsm_idle_exit(struct sbi_scratch *scratch) { }
+
+static inline int sbi_hsm_idle_get_stat(u32 hartid, u32 state, u32 stat,
+					u64 *out_val)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void sbi_hsm_idle_test_enable(void) { }
+
+#endif
+
+#endif
@@ -10,8 +10,10 @@
 #ifndef __SBI_PMU_H__
 #define __SBI_PMU_H__
 
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_types.h>
 
+struct sbi_domain;
 struct sbi_scratch;
 
 /* Event related macros */
@@ -21,10 +23,51 @@ struct sbi_scratch;
 /* Counter related macros */
 #define SBI_PMU_FW_CTR_MAX 16
 #define SBI_PMU_HW_CTR_MAX 32
-#define SBI_PMU_CTR_MAX	   (SBI_PMU_HW_CTR_MAX + SBI_PMU_FW_CTR_MAX)
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+#define SBI_PMU_MUX_CTR_MAX 16
+#else
+#define SBI_PMU_MUX_CTR_MAX 0
+#endif
+#define SBI_PMU_CTR_MAX	   (SBI_PMU_HW_CTR_MAX + SBI_PMU_FW_CTR_MAX + \
+			    SBI_PMU_MUX_CTR_MAX)
 #define SBI_PMU_FIXED_CTR_MASK 0x07
 #define SBI_PMU_CY_IR_MASK	0x05
 
+/*
+ * OpenSBI specific extension (firmware specific extension space) to get
+ * the enabled and running times of multiplexed counters.
+ */
+#define SBI_EXT_PMU_MUX				0x0A504D58
+
+/** Function IDs of the multiplexed counter extension */
+enum sbi_ext_pmu_mux_fid {
+	/* a0: counter index, a1: enum sbi_pmu_mux_time, returns the time */
+	SBI_EXT_PMU_MUX_GET_TIME = 0,
+	/* Same as above, returns the upper 32 bits of the time on RV32 */
+	SBI_EXT_PMU_MUX_GET_TIME_HI,
+};
+
+/** Times tracked for multiplexed counters (in timer ticks) */
+enum sbi_pmu_mux_time {
+	/** Time the counter was started by supervisor */
+	SBI_PMU_MUX_TIME_ENABLED = 0,
+	/** Time the counter was scheduled on a hardware counter */
+	SBI_PMU_MUX_TIME_RUNNING,
+	SBI_PMU_MUX_TIME_MAX,
+};
+
+/* Size of the counter snapshot shared memory */
+#define SBI_PMU_SNAPSHOT_SIZE	4096
+
+/** Layout of the counter snapshot shared memory (SBI v2.0) */
+struct sbi_pmu_snapshot {
+	/** Bitmap of overflown counters relative to the counter base */
+	uint64_t ctr_overflow_mask;
+	/** Counter values relative to the counter base */
+	uint64_t ctr_values[64];
+	uint64_t reserved[447];
+};
+
 struct sbi_pmu_device {
 	/** Name of the PMU platform device */
 	char name[32];
@@ -96,6 +139,12 @@ struct sbi_pmu_device {
 	 * specified mode.
 	 */
 	void (*hw_counter_filter_mode)(unsigned long flags, int counter_index);
+
+	/**
+	 * Custom function to raise the counter overflow interrupt to
+	 * supervisor on overflow of a firmware counter.
+	 */
+	void (*counter_overflow_raise_irq)(void);
 };
 
 /** Get the PMU platform device */
@@ -150,4 +199,59 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 
 int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id);
 
+/**
+ * Set or disable the counter snapshot shared memory of current HART
+ * @param dom domain of current HART
+ * @param smode privilege mode of the caller
+ * @param shmem_phys_lo lower XLEN bits of the physical address
+ * @param shmem_phys_hi upper XLEN bits of the physical address
+ * @param flags must be zero
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_pmu_snapshot_set_shmem(const struct sbi_domain *dom,
+			       unsigned long smode,
+			       unsigned long shmem_phys_lo,
+			       unsigned long shmem_phys_hi,
+			       unsigned long flags);
+
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+/**
+ * Get the enabled or running time of a multiplexed counter of current HART
+ * @param cidx counter index
+ * @param type time to get (enum sbi_pmu_mux_time)
+ * @param time pointer to store the time in timer ticks
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int sbi_pmu_ctr_mux_get_time(uint32_t cidx, uint32_t type, uint64_t *time);
+
+/**
+ * Read a multiplexed counter through its trapping hpmcounter CSR
+ * @param csr_num hpmcounter (or hpmcounterh on RV32) CSR number
+ * @param csr_val pointer to store the counter value
+ * @return 0 on success and SBI_ENOTSUPP if not a multiplexed counter CSR
+ */
+int sbi_pmu_ctr_mux_csr_read(int csr_num, unsigned long *csr_val);
+
+/** Rotate multiplexed counters on hardware counters of current HART */
+void sbi_pmu_mux_rotate(void);
+
+#else
+
+static inline int sbi_pmu_ctr_mux_get_time(uint32_t cidx, uint32_t type,
+					   uint64_t *time)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int sbi_pmu_ctr_mux_csr_read(int csr_num,
+					   unsigned long *csr_val)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void sbi_pmu_mux_rotate(void) { }
+
+#endif
+
 #endif
@@ -44,6 +44,12 @@
 #define SBI_SCRATCH_OPTIONS_OFFSET		(13 * __SIZEOF_POINTER__)
 /** Offset of extra space in sbi_scratch */
 #define SBI_SCRATCH_EXTRA_SPACE_OFFSET		(14 * __SIZEOF_POINTER__)
+/** Size of cache line assumed for placing extra space allocations */
+#define SBI_SCRATCH_CACHE_LINE_SIZE		64
+/** Offset of queued spinlock nodes (one cache line) in extra space */
+#define SBI_SCRATCH_QSPIN_NODES_OFFSET		\
+	((SBI_SCRATCH_EXTRA_SPACE_OFFSET + SBI_SCRATCH_CACHE_LINE_SIZE - 1) & \
+	 ~(SBI_SCRATCH_CACHE_LINE_SIZE - 1))
 /** Maximum size of sbi_scratch (4KB) */
 #define SBI_SCRATCH_SIZE			(0x1000)
 
@@ -161,6 +167,14 @@ enum sbi_scratch_options {
 #define sbi_scratch_thishart_arg1_ptr() \
 	((void *)(sbi_scratch_thishart_ptr()->next_arg1))
 
+/** Placement flags of extra space allocations */
+enum sbi_scratch_alloc_flags {
+	/** Written by other HARTs, placed in cache lines of its own */
+	SBI_SCRATCH_ALLOC_REMOTE_WRITTEN = (1 << 0),
+	/** Used on hot paths of the local HART, placed near sbi_scratch */
+	SBI_SCRATCH_ALLOC_LOCAL_HOT = (1 << 1),
+};
+
 /** Initialize scratch table and allocator */
 int sbi_scratch_init(struct sbi_scratch *scratch);
 
@@ -172,12 +186,26 @@ int sbi_scratch_init(struct sbi_scratch *scratch);
  */
 unsigned long sbi_scratch_alloc_offset(unsigned long size);
 
+/**
+ * Allocate from extra space in sbi_scratch with placement flags
+ *
+ * @param size size of the allocation
+ * @param flags placement flags (enum sbi_scratch_alloc_flags)
+ * @return zero on failure and non-zero (>= SBI_SCRATCH_EXTRA_SPACE_OFFSET)
+ * on success
+ */
+unsigned long sbi_scratch_alloc_offset_flags(unsigned long size,
+					     unsigned long flags);
+
 /** Free-up extra space in sbi_scratch */
 void sbi_scratch_free_offset(unsigned long offset);
 
 /** Amount (in bytes) of used space in in sbi_scratch */
 unsigned long sbi_scratch_used_space(void);
 
+/** Print the layout of extra space in sbi_scratch */
+void sbi_scratch_dump_layout(void);
+
 /** Get pointer from offset in sbi_scratch */
 #define sbi_scratch_offset_ptr(scratch, offset)	(void *)((char *)(scratch) + (offset))
 
@@ -189,6 +217,10 @@ unsigned long sbi_scratch_used_space(void);
 #define sbi_scratch_alloc_type_offset(__type)				\
 	sbi_scratch_alloc_offset(sizeof(__type))
 
+/** Allocate offset for a data type in sbi_scratch with placement flags */
+#define sbi_scratch_alloc_type_offset_flags(__type, __flags)		\
+	sbi_scratch_alloc_offset_flags(sizeof(__type), (__flags))
+
 /** Read a data type from sbi_scratch at given offset */
 #define sbi_scratch_read_type(__scratch, __type, __offset)		\
 ({									\
@@ -81,9 +81,27 @@ void sbi_timer_set_delta(ulong delta);
 /** Set upper 32-bits of timer delta value for current HART */
 void sbi_timer_set_delta_upper(ulong delta_upper);
 
+/**
+ * Get the next timer event programmed for current HART
+ *
+ * @return absolute timer value of the pending event, or -1ULL when no
+ * event is pending
+ */
+u64 sbi_timer_next_event(void);
+
 /** Start timer event for current HART */
 void sbi_timer_event_start(u64 next_event);
 
+/**
+ * Start an M-mode timer event of current HART for firmware own use
+ *
+ * This is only possible with Sstc, where supervisor timer events do not
+ * go through the M-mode timer. The event ends up in sbi_timer_process().
+ *
+ * @return 0 on success and SBI_ENOTSUPP if not available
+ */
+int sbi_timer_mmode_event_start(u64 next_event);
+
 /** Process timer event for current HART */
 void sbi_timer_process(void);
 
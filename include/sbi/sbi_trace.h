@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#ifndef __SBI_TRACE_H__
+#define __SBI_TRACE_H__
+
+#include <sbi/sbi_types.h>
+
+/*
+ * Binary trace format. Keep in sync with scripts/sbi_trace_decode.py
+ * which decodes rings found in memory dumps or in the console output of
+ * sbi_trace_dump().
+ */
+
+/** Magic of a trace ring ("SBTR" in little endian) */
+#define SBI_TRACE_MAGIC			0x52544253
+/** Version of the trace format */
+#define SBI_TRACE_VERSION		1
+/** Maximum number of arguments of a trace record */
+#define SBI_TRACE_MAX_ARGS		4
+
+/** Trace events (arguments in comments) */
+enum sbi_trace_event {
+	SBI_TRACE_NONE = 0,
+	/** Ecall entry: extension id, function id, a0, a1 */
+	SBI_TRACE_ECALL_ENTER,
+	/** Ecall exit: extension id, function id, error, value */
+	SBI_TRACE_ECALL_EXIT,
+	/** IPI sent: target hartid, IPI event */
+	SBI_TRACE_IPI_SEND,
+	/** IPI processed: pending IPI events bitmap */
+	SBI_TRACE_IPI_PROCESS,
+	/** Local remote fence: tlb type, start, size, asid or vmid */
+	SBI_TRACE_RFENCE,
+	/** HSM state change: target hartid, old state, new state */
+	SBI_TRACE_HSM_STATE,
+	SBI_TRACE_EVENT_MAX,
+};
+
+/** Fixed size trace record */
+struct sbi_trace_record {
+	/** Timer value when the event was recorded */
+	u64 time;
+	/** HART which recorded the event */
+	u32 hartid;
+	/** Event id (enum sbi_trace_event) */
+	u32 event;
+	/** Event arguments (unused ones are zero) */
+	u64 args[SBI_TRACE_MAX_ARGS];
+};
+
+/** Per-HART trace ring, followed by its records */
+struct sbi_trace_ring {
+	/** Magic (SBI_TRACE_MAGIC) */
+	u32 magic;
+	/** Version of the trace format */
+	u16 version;
+	/** Size of a trace record */
+	u16 record_size;
+	/** HART owning the ring */
+	u32 hartid;
+	/** Number of records in the ring (power of 2) */
+	u32 nr_records;
+	/** Number of records written so far */
+	u64 head;
+	/** Frequency of the timer used for timestamps */
+	u64 timer_freq;
+	u8 reserved[32];
+	struct sbi_trace_record records[];
+};
+
+struct sbi_scratch;
+
+#ifdef CONFIG_SBI_TRACE
+
+/** Number of records in the trace ring of each HART */
+#define SBI_TRACE_RING_RECORDS		(1UL << CONFIG_SBI_TRACE_RING_ORDER)
+
+/** Heap space taken by the trace ring of each HART */
+#define SBI_TRACE_RING_HEAP_SIZE	(sizeof(struct sbi_trace_ring) + \
+		SBI_TRACE_RING_RECORDS * sizeof(struct sbi_trace_record) + 128)
+
+/** Record a trace event in the ring of current HART */
+void __sbi_trace(u32 event, u64 arg0, u64 arg1, u64 arg2, u64 arg3);
+
+/** Print the trace rings of all HARTs as hex lines on the console */
+void sbi_trace_dump(void);
+
+/** Initialize trace rings */
+int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#else
+
+#define SBI_TRACE_RING_HEAP_SIZE	0
+
+static inline void __sbi_trace(u32 event, u64 arg0, u64 arg1, u64 arg2,
+			       u64 arg3) { }
+
+static inline void sbi_trace_dump(void) { }
+
+static inline int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	return 0;
+}
+
+#endif
+
+#define sbi_trace(__event, __arg0, __arg1, __arg2, __arg3)		\
+	__sbi_trace((__event), (u64)(__arg0), (u64)(__arg1),		\
+		    (u64)(__arg2), (u64)(__arg3))
+
+#endif
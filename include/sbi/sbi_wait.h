@@ -0,0 +1,70 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#ifndef __SBI_WAIT_H__
+#define __SBI_WAIT_H__
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_types.h>
+
+/** State of a wait loop */
+struct sbi_wait_state {
+	/** Fall back to WFI instead of PAUSE (the waker sends an interrupt) */
+	bool idle;
+	/** Wait method was selected */
+	bool probed;
+	/** Stall in WRS.NTO until the location is written */
+	bool wrs;
+	/** Current backoff (log2 of PAUSE instructions) */
+	u8 backoff;
+};
+
+#define SBI_WAIT_STATE_INIT(__idle)	{ .idle = (__idle) }
+
+/**
+ * Relax between two checks of a wait loop
+ *
+ * With Zawrs the HART stalls until the location at @ptr no longer holds
+ * @old (or an interrupt is pending). Otherwise it pauses with exponential
+ * backoff, or executes WFI for idle waits.
+ *
+ * @param ws state of the wait loop
+ * @param ptr watched location (NULL for a pure backoff)
+ * @param size size of the watched location
+ * @param old value last read from the watched location
+ */
+void sbi_wait_relax(struct sbi_wait_state *ws, volatile void *ptr,
+		    unsigned int size, unsigned long old);
+
+#define __sbi_wait_on(__ptr, __cond, __idle)				\
+({									\
+	struct sbi_wait_state __ws = SBI_WAIT_STATE_INIT(__idle);	\
+	__typeof__(*(__ptr)) VAL;					\
+	for (;;) {							\
+		VAL = __smp_load_acquire(__ptr);			\
+		if (__cond)						\
+			break;						\
+		sbi_wait_relax(&__ws, (__ptr), sizeof(*(__ptr)),	\
+			       (unsigned long)VAL);			\
+	}								\
+	VAL;								\
+})
+
+/**
+ * Wait until a condition on a memory location becomes true
+ *
+ * The condition is evaluated with VAL holding the value of *ptr loaded
+ * with acquire ordering, and the final value is returned.
+ */
+#define sbi_wait_on(__ptr, __cond)	__sbi_wait_on(__ptr, __cond, false)
+
+/**
+ * Same as sbi_wait_on() but for long waits ended by an interrupt to the
+ * waiting HART, which executes WFI when Zawrs is not available.
+ */
+#define sbi_wait_on_idle(__ptr, __cond)	__sbi_wait_on(__ptr, __cond, true)
+
+#endif
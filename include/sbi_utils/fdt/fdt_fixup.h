@@ -9,15 +9,90 @@
 #ifndef __FDT_FIXUP_H__
 #define __FDT_FIXUP_H__
 
-struct sbi_cpu_idle_state {
-	const char *name;
-	uint32_t suspend_param;
-	bool local_timer_stop;
-	uint32_t entry_latency_us;
-	uint32_t exit_latency_us;
-	uint32_t min_residency_us;
-	uint32_t wakeup_latency_us;
-};
+#include <libfdt.h>
+#include <sbi/sbi_hsm_idle.h>
+
+/**
+ * Begin a batch of DT fix-ups
+ *
+ * Edits recorded by the fdt_fixup_*() routines below are not applied to the
+ * device tree until the outermost fdt_fixup_end(), which emits the fixed
+ * device tree in a single pass. Node offsets of the device tree are therefore
+ * stable for the whole batch. Batches can be nested for the same device tree.
+ *
+ * @param fdt: device tree blob
+ * @return zero on success and -ve on failure
+ */
+int fdt_fixup_begin(void *fdt);
+
+/**
+ * End a batch of DT fix-ups
+ *
+ * The outermost call applies all edits recorded in the batch to the device
+ * tree. The device tree grows by at most the space needed by the edits.
+ * On failure, none of the edits is applied and the device tree stays valid.
+ *
+ * @param fdt: device tree blob
+ * @return zero on success and -ve on failure
+ */
+int fdt_fixup_end(void *fdt);
+
+/**
+ * Record setting a property of a node in the current batch of DT fix-ups
+ *
+ * @param fdt: device tree blob
+ * @param nodeoff: offset of the node or node returned by fdt_fixup_add_subnode()
+ * @param name: name of the property
+ * @param val: value of the property (copied)
+ * @param len: length of the value
+ * @return zero on success and -ve on failure
+ */
+int fdt_fixup_setprop(void *fdt, int nodeoff, const char *name,
+		      const void *val, int len);
+
+static inline int fdt_fixup_setprop_string(void *fdt, int nodeoff,
+					   const char *name, const char *str)
+{
+	return fdt_fixup_setprop(fdt, nodeoff, name, str, strlen(str) + 1);
+}
+
+static inline int fdt_fixup_setprop_u32(void *fdt, int nodeoff,
+					const char *name, u32 val)
+{
+	fdt32_t tmp = cpu_to_fdt32(val);
+
+	return fdt_fixup_setprop(fdt, nodeoff, name, &tmp, sizeof(tmp));
+}
+
+static inline int fdt_fixup_setprop_empty(void *fdt, int nodeoff,
+					  const char *name)
+{
+	return fdt_fixup_setprop(fdt, nodeoff, name, NULL, 0);
+}
+
+/** Record deleting a property in the current batch of DT fix-ups */
+int fdt_fixup_delprop(void *fdt, int nodeoff, const char *name);
+
+/**
+ * Record adding a sub-node in the current batch of DT fix-ups
+ *
+ * @param fdt: device tree blob
+ * @param parentoff: offset of the parent node or node returned by
+ * fdt_fixup_add_subnode()
+ * @param name: name of the sub-node
+ * @return handle of the new node for other fdt_fixup_*() routines on success
+ * and -ve on failure
+ */
+int fdt_fixup_add_subnode(void *fdt, int parentoff, const char *name);
+
+/** Record deleting a node in the current batch of DT fix-ups */
+int fdt_fixup_del_node(void *fdt, int nodeoff);
+
+/**
+ * Same as fdt_node_is_enabled() but also considers the "status" property
+ * edits recorded in the current batch of DT fix-ups
+ */
+bool fdt_fixup_node_is_enabled(void *fdt, int nodeoff);
 
 /**
  * Add CPU idle states to cpu nodes in the DT
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * fdt_index.h - Lookup index of the Flat Device Tree
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#ifndef __FDT_INDEX_H__
+#define __FDT_INDEX_H__
+
+#include <libfdt.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_types.h>
+
+#ifdef CONFIG_FDT_INDEX
+
+/**
+ * Build the lookup index of a FDT
+ *
+ * The index maps compatible strings to nodes, phandles to node offsets,
+ * nodes to their parents and cpu nodes to hart ids. It refers to the FDT
+ * so it must be invalidated before the FDT is modified.
+ *
+ * @param fdt FDT to index
+ * @return 0 on success and SBI_Exxx (< 0) on failure
+ */
+int fdt_index_build(const void *fdt);
+
+/**
+ * Get the heap space needed to index a FDT
+ *
+ * @param fdt FDT to index
+ * @return upper bound of the heap space used by fdt_index_build()
+ */
+unsigned long fdt_index_heap_size(const void *fdt);
+
+/** Invalidate the lookup index before modifying the indexed FDT */
+void fdt_index_invalidate(void);
+
+/** Same as fdt_node_offset_by_compatible() but uses the index if valid */
+int fdt_index_node_offset_by_compatible(const void *fdt, int startoffset,
+					const char *compatible);
+
+/** Same as fdt_node_offset_by_phandle() but uses the index if valid */
+int fdt_index_node_offset_by_phandle(const void *fdt, uint32_t phandle);
+
+/** Same as fdt_parent_offset() but uses the index if valid */
+int fdt_index_parent_offset(const void *fdt, int nodeoffset);
+
+/**
+ * Get the hart id of a cpu node from the index
+ * @return 0 on success, SBI_EINVAL if the node is not a valid cpu node
+ * and SBI_ENOSYS if the index is not valid
+ */
+int fdt_index_hart_id(const void *fdt, int cpu_offset, u32 *hartid);
+
+#else
+
+static inline int fdt_index_build(const void *fdt) { return 0; }
+
+static inline unsigned long fdt_index_heap_size(const void *fdt)
+{
+	return 0;
+}
+
+static inline void fdt_index_invalidate(void) { }
+
+static inline int fdt_index_node_offset_by_compatible(const void *fdt,
+						      int startoffset,
+						      const char *compatible)
+{
+	return fdt_node_offset_by_compatible(fdt, startoffset, compatible);
+}
+
+static inline int fdt_index_node_offset_by_phandle(const void *fdt,
+						   uint32_t phandle)
+{
+	return fdt_node_offset_by_phandle(fdt, phandle);
+}
+
+static inline int fdt_index_parent_offset(const void *fdt, int nodeoffset)
+{
+	return fdt_parent_offset(fdt, nodeoffset);
+}
+
+static inline int fdt_index_hart_id(const void *fdt, int cpu_offset,
+				    u32 *hartid)
+{
+	return SBI_ENOSYS;
+}
+
+#endif
+
+#endif /* __FDT_INDEX_H__ */
@@ -11,8 +11,12 @@
 #ifndef __FDT_PMU_H__
 #define __FDT_PMU_H__
 
+#include <sbi/sbi_pmu.h>
 #include <sbi/sbi_types.h>
 
+/** Number of entries in fdt_pmu_evt_select[] */
+#define FDT_PMU_HW_EVENT_MAX (SBI_PMU_HW_EVENT_MAX * 2)
+
 struct fdt_pmu_hw_event_select_map {
 	uint32_t eidx;
 	uint64_t select;
@@ -12,6 +12,8 @@
 
 #include <sbi/sbi_types.h>
 
+void uart8250_set_fifo_size(u32 fifo_size);
+
 int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 		  u32 reg_width, u32 reg_offset);
 
@@ -12,7 +12,8 @@
 
 int htif_serial_init(bool custom_addr,
 		     unsigned long custom_fromhost_addr,
-		     unsigned long custom_tohost_addr);
+		     unsigned long custom_tohost_addr,
+		     bool bulk_write);
 
 int htif_system_reset_init(bool custom_addr,
 			   unsigned long custom_fromhost_addr,
@@ -5,8 +5,250 @@
  * Copyright (c) 2021 Christoph Müllner <cmuellner@linux.com>
  */
 
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_atomic.h>
 #include <sbi/riscv_barrier.h>
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_wait.h>
+
+/* Number of queued spinlocks a HART can hold or wait for at a time */
+#define QSPIN_NODES_MAX		3
+
+/** Queue nodes of a HART in its scratch space */
+struct qspin_hart_nodes {
+	/** Bitmap of nodes in use */
+	unsigned long used;
+	struct qspin_node node[QSPIN_NODES_MAX];
+};
+
+_Static_assert(sizeof(struct qspin_hart_nodes) <= SBI_SCRATCH_CACHE_LINE_SIZE,
+	       "queued spinlock nodes do not fit in a cache line");
+
+static struct qspin_node *qspin_node_get(void)
+{
+	struct qspin_hart_nodes *hn =
+		sbi_scratch_thishart_offset_ptr(SBI_SCRATCH_QSPIN_NODES_OFFSET);
+	int i;
+
+	for (i = 0; i < QSPIN_NODES_MAX; i++) {
+		if (hn->used & BIT(i))
+			continue;
+		hn->used |= BIT(i);
+		hn->node[i].next = NULL;
+		hn->node[i].locked = 0;
+		return &hn->node[i];
+	}
+
+	/* Queued spinlocks nested deeper than nodes available */
+	return NULL;
+}
+
+static void qspin_node_put(struct qspin_node *node)
+{
+	struct qspin_hart_nodes *hn =
+		sbi_scratch_thishart_offset_ptr(SBI_SCRATCH_QSPIN_NODES_OFFSET);
+
+	hn->used &= ~BIT(node - hn->node);
+}
+
+#ifdef CONFIG_SBI_SPINLOCK_STATS
+
+#define QSPIN_STATS_LOCKS_MAX	16
+
+static qspinlock_t *qspin_stats_locks[QSPIN_STATS_LOCKS_MAX];
+static atomic_t qspin_stats_count = ATOMIC_INITIALIZER(0);
+
+void qspin_lock_stats_register(qspinlock_t *lock, const char *name)
+{
+	long i = atomic_add_return(&qspin_stats_count, 1) - 1;
+
+	lock->stats.name = name;
+	if (i < QSPIN_STATS_LOCKS_MAX)
+		qspin_stats_locks[i] = lock;
+}
+
+void qspin_lock_stats_dump(void)
+{
+	long i, count = atomic_read(&qspin_stats_count);
+	struct qspin_lock_stats *st;
+
+	for (i = 0; i < count && i < QSPIN_STATS_LOCKS_MAX; i++) {
+		if (!qspin_stats_locks[i])
+			continue;
+		st = &qspin_stats_locks[i]->stats;
+		sbi_printf("%-16s: %lu acquired, %lu contended, %lu spins, "
+			   "%lu max wait cycles, %lu failed trylocks\n",
+			   st->name, st->acquisitions, st->contended, st->spins,
+			   st->max_wait_cycles, st->trylock_failed);
+	}
+}
+
+static void qspin_stats_update(qspinlock_t *lock, bool contended,
+			       unsigned long spins, unsigned long start)
+{
+	unsigned long wait = csr_read(CSR_MCYCLE) - start;
+
+	/* Updated with the lock held */
+	lock->stats.acquisitions++;
+	if (!contended)
+		return;
+	lock->stats.contended++;
+	lock->stats.spins += spins;
+	if (lock->stats.max_wait_cycles < wait)
+		lock->stats.max_wait_cycles = wait;
+}
+
+static void qspin_stats_trylock_failed(qspinlock_t *lock)
+{
+	__atomic_fetch_add(&lock->stats.trylock_failed, 1, __ATOMIC_RELAXED);
+}
+
+#define qspin_stats_start()	csr_read(CSR_MCYCLE)
+
+#else
+
+static inline void qspin_stats_update(qspinlock_t *lock, bool contended,
+				      unsigned long spins, unsigned long start)
+{
+}
+
+static inline void qspin_stats_trylock_failed(qspinlock_t *lock) { }
+
+#define qspin_stats_start()	0
+
+#endif
+
+bool qspin_lock_check(qspinlock_t *lock)
+{
+	RISCV_FENCE(r, rw);
+	return lock->tail != NULL;
+}
+
+/* Take the lock with a node which is free, false if the lock is held */
+static bool __qspin_trylock(qspinlock_t *lock, struct qspin_node *node)
+{
+	if (lock->tail ||
+	    __sync_val_compare_and_swap(&lock->tail, NULL, node))
+		return false;
+
+	lock->owner = node;
+	return true;
+}
+
+bool qspin_trylock(qspinlock_t *lock)
+{
+	unsigned long start = qspin_stats_start();
+	struct qspin_node *node = qspin_node_get();
+
+	if (!__qspin_trylock(lock, (node) ? node : &lock->fallback)) {
+		if (node)
+			qspin_node_put(node);
+		qspin_stats_trylock_failed(lock);
+		return false;
+	}
+
+	qspin_stats_update(lock, false, 0, start);
+	return true;
+}
+
+/*
+ * Without a free node of its own, a HART cannot queue so it waits for
+ * the lock to be free and takes it with the node embedded in the lock.
+ * Only one HART holds the lock so the embedded node is never shared.
+ */
+static void qspin_lock_fallback(qspinlock_t *lock, unsigned long start)
+{
+	struct sbi_wait_state ws = SBI_WAIT_STATE_INIT(false);
+	unsigned long spins = 0;
+	struct qspin_node *tail;
+
+	while (!__qspin_trylock(lock, &lock->fallback)) {
+		spins++;
+		tail = __smp_load_acquire(&lock->tail);
+		if (tail)
+			sbi_wait_relax(&ws, &lock->tail, sizeof(lock->tail),
+				       (unsigned long)tail);
+	}
+
+	qspin_stats_update(lock, spins != 0, spins, start);
+}
+
+void qspin_lock(qspinlock_t *lock)
+{
+	unsigned long spins = 0, start = qspin_stats_start();
+	struct sbi_wait_state ws = SBI_WAIT_STATE_INIT(false);
+	struct qspin_node *node = qspin_node_get(), *prev;
+	u32 locked;
+
+	if (!node) {
+		qspin_lock_fallback(lock, start);
+		return;
+	}
+
+	prev = (struct qspin_node *)atomic_raw_xchg_ulong(
+				(volatile unsigned long *)&lock->tail,
+				(unsigned long)node);
+	if (prev) {
+		/* Queue behind the previous HART and wait on our own node */
+		__smp_store_release(&prev->next, node);
+		while (!(locked = __smp_load_acquire(&node->locked))) {
+			spins++;
+			sbi_wait_relax(&ws, &node->locked,
+				       sizeof(node->locked), locked);
+		}
+	}
+
+	lock->owner = node;
+	qspin_stats_update(lock, prev != NULL, spins, start);
+}
+
+void qspin_unlock(qspinlock_t *lock)
+{
+	struct qspin_node *node = lock->owner, *next;
+
+	next = __smp_load_acquire(&node->next);
+	if (!next) {
+		/* No waiter unless one is between the xchg and the store */
+		if (__sync_val_compare_and_swap(&lock->tail, node, NULL) ==
+		    node)
+			goto done;
+		next = sbi_wait_on(&node->next, VAL);
+	}
+
+	/* The embedded node is taken again as soon as the lock is free */
+	node->next = NULL;
+	__smp_store_release(&next->locked, 1);
+done:
+	if (node != &lock->fallback)
+		qspin_node_put(node);
+}
+
+#ifdef CONFIG_SBI_SPINLOCK_QUEUED
+
+bool spin_lock_check(spinlock_t *lock)
+{
+	return qspin_lock_check(lock);
+}
+
+bool spin_trylock(spinlock_t *lock)
+{
+	return qspin_trylock(lock);
+}
+
+void spin_lock(spinlock_t *lock)
+{
+	qspin_lock(lock);
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+	qspin_unlock(lock);
+}
+
+#else
 
 static inline bool spin_lock_unlocked(spinlock_t lock)
 {
@@ -48,30 +290,24 @@ bool spin_trylock(spinlock_t *lock)
 void spin_lock(spinlock_t *lock)
 {
 	unsigned long inc = 1u << TICKET_SHIFT;
-	unsigned long mask = 0xffffu;
-	u32 l0, tmp1, tmp2;
+	u32 l0, ticket;
 
+	/* Atomically increment the next ticket. */
 	__asm__ __volatile__(
-		/* Atomically increment the next ticket. */
-		"	amoadd.w.aqrl	%0, %4, %3\n"
-
-		/* Did we get the lock? */
-		"	srli	%1, %0, %6\n"
-		"	and	%1, %1, %5\n"
-		"1:	and	%2, %0, %5\n"
-		"	beq	%1, %2, 2f\n"
-
-		/* If not, then spin on the lock. */
-		"	lw	%0, %3\n"
-		RISCV_ACQUIRE_BARRIER
-		"	j	1b\n"
-		"2:"
-		: "=&r"(l0), "=&r"(tmp1), "=&r"(tmp2), "+A"(*lock)
-		: "r"(inc), "r"(mask), "I"(TICKET_SHIFT)
+		"	amoadd.w.aqrl	%0, %2, %1\n"
+		: "=&r"(l0), "+A"(*lock)
+		: "r"(inc)
 		: "memory");
+
+	/* Did we get the lock? If not, then wait on the lock. */
+	ticket = (l0 >> TICKET_SHIFT) & 0xffffu;
+	if ((l0 & 0xffffu) != ticket)
+		sbi_wait_on((volatile u32 *)lock, (VAL & 0xffffu) == ticket);
 }
 
 void spin_unlock(spinlock_t *lock)
 {
 	__smp_store_release(&lock->owner, lock->owner + 1);
 }
+
+#endif
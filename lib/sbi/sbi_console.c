@@ -7,12 +7,15 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_barrier.h>
 #include <sbi/riscv_locks.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 
 #define CONSOLE_TBUF_MAX 256
 
@@ -63,6 +66,214 @@ static void nputs_all(const char *str, unsigned long len)
 		p += nputs(&str[p], len - p);
 }
 
+#ifdef CONFIG_SBI_CONSOLE_BUFFERED
+
+#define CONSOLE_RING_SIZE	SBI_CONSOLE_RING_SIZE
+
+/** Header of a message in a console ring */
+struct console_ring_msg {
+	/** Timer value when the message was written */
+	u64 time;
+	/** Length of the message following the header */
+	u32 len;
+};
+
+/** Console ring of a HART, written by the HART and read by any HART */
+struct console_ring {
+	/** Write position, only updated by the owner HART */
+	u32 head;
+	/** Read position, only updated by the draining HART */
+	u32 tail;
+	char buf[CONSOLE_RING_SIZE];
+};
+
+static unsigned long console_ring_offset;
+static bool console_buffered;
+static bool console_pending;
+static spinlock_t console_drain_lock = SPIN_LOCK_INITIALIZER;
+
+static struct console_ring *console_ring_get(struct sbi_scratch *scratch)
+{
+	if (!console_ring_offset || !scratch)
+		return NULL;
+	return sbi_scratch_read_type(scratch, struct console_ring *,
+				     console_ring_offset);
+}
+
+static void console_ring_copy_in(struct console_ring *ring, u32 pos,
+				 const void *src, u32 len)
+{
+	u32 i;
+
+	for (i = 0; i < len; i++)
+		ring->buf[(pos + i) & (CONSOLE_RING_SIZE - 1)] =
+						((const char *)src)[i];
+}
+
+static void console_ring_copy_out(struct console_ring *ring, u32 pos,
+				  void *dst, u32 len)
+{
+	u32 i;
+
+	for (i = 0; i < len; i++)
+		((char *)dst)[i] =
+			ring->buf[(pos + i) & (CONSOLE_RING_SIZE - 1)];
+}
+
+/* Write the oldest pending message of all HARTs, false if none */
+static bool console_drain_one(void)
+{
+	struct console_ring *ring, *oldest = NULL;
+	struct console_ring_msg msg, omsg;
+	char chunk[64];
+	u32 i, pos, len;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		ring = console_ring_get(sbi_hartindex_to_scratch(i));
+		if (!ring || ring->tail == __smp_load_acquire(&ring->head))
+			continue;
+
+		console_ring_copy_out(ring, ring->tail, &msg, sizeof(msg));
+		if (!oldest || msg.time < omsg.time) {
+			oldest = ring;
+			omsg = msg;
+		}
+	}
+	if (!oldest)
+		return false;
+
+	spin_lock(&console_out_lock);
+	pos = oldest->tail + sizeof(omsg);
+	while (omsg.len) {
+		len = MIN(omsg.len, (u32)sizeof(chunk));
+		console_ring_copy_out(oldest, pos, chunk, len);
+		nputs_all(chunk, len);
+		pos += len;
+		omsg.len -= len;
+	}
+	spin_unlock(&console_out_lock);
+
+	__smp_store_release(&oldest->tail, pos);
+	return true;
+}
+
+static void console_drain(bool wait)
+{
+	if (!console_buffered)
+		return;
+
+	/*
+	 * The active drainer clears the flag before it is done, so only
+	 * opportunistic drains may skip on it. Waiting drains always take
+	 * the lock and so also wait for the active drainer to finish.
+	 */
+	if (wait)
+		spin_lock(&console_drain_lock);
+	else if (!__smp_load_acquire(&console_pending) ||
+		 !spin_trylock(&console_drain_lock))
+		return;
+
+	/* Writers set the flag after publishing, so clear it before reading */
+	console_pending = false;
+	smp_mb();
+
+	while (console_drain_one())
+		;
+
+	spin_unlock(&console_drain_lock);
+}
+
+void sbi_console_drain(void)
+{
+	console_drain(false);
+}
+
+void sbi_console_buffer_enable(void)
+{
+	if (console_ring_offset)
+		console_buffered = true;
+}
+
+/* Queue a message in the ring of the current HART */
+static bool console_ring_write(const char *str, u32 len)
+{
+	struct console_ring *ring;
+	struct console_ring_msg msg;
+	u32 head;
+
+	if (!console_buffered ||
+	    (sizeof(msg) + len) > CONSOLE_RING_SIZE)
+		return false;
+
+	ring = console_ring_get(sbi_scratch_thishart_ptr());
+	if (!ring)
+		return false;
+
+	/* Make room by draining all rings when ours is full */
+	head = ring->head;
+	while ((CONSOLE_RING_SIZE - (head - __smp_load_acquire(&ring->tail))) <
+	       (sizeof(msg) + len))
+		console_drain(true);
+
+	msg.time = sbi_timer_value();
+	msg.len = len;
+	console_ring_copy_in(ring, head, &msg, sizeof(msg));
+	console_ring_copy_in(ring, head + sizeof(msg), str, len);
+	__smp_store_release(&ring->head, head + sizeof(msg) + len);
+	__smp_store_release(&console_pending, true);
+
+	return true;
+}
+
+static int console_ring_init(void)
+{
+	struct sbi_scratch *rscratch;
+	struct console_ring *ring;
+	u32 i;
+
+	console_ring_offset = sbi_scratch_alloc_type_offset(void *);
+	if (!console_ring_offset)
+		return SBI_ENOMEM;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+
+		ring = sbi_zalloc(sizeof(*ring));
+		if (!ring)
+			return SBI_ENOMEM;
+		sbi_scratch_write_type(rscratch, struct console_ring *,
+				       console_ring_offset, ring);
+	}
+
+	return 0;
+}
+
+#else
+
+static inline bool console_ring_write(const char *str, u32 len)
+{
+	return false;
+}
+
+static inline int console_ring_init(void)
+{
+	return 0;
+}
+
+static inline void console_drain(bool wait) { }
+
+#endif
+
+void sbi_console_flush(void)
+{
+	console_drain(true);
+
+	if (console_dev && console_dev->console_flush)
+		console_dev->console_flush();
+}
+
 void sbi_putc(char ch)
 {
 	nputs_all(&ch, 1);
@@ -72,6 +283,10 @@ void sbi_puts(const char *str)
 {
 	unsigned long len = sbi_strlen(str);
 
+	if (console_ring_write(str, len))
+		return;
+	console_drain(true);
+
 	spin_lock(&console_out_lock);
 	nputs_all(str, len);
 	spin_unlock(&console_out_lock);
@@ -81,6 +296,9 @@ unsigned long sbi_nputs(const char *str, unsigned long len)
 {
 	unsigned long ret;
 
+	/* Keep the order with buffered firmware messages */
+	console_drain(true);
+
 	spin_lock(&console_out_lock);
 	ret = nputs(str, len);
 	spin_unlock(&console_out_lock);
@@ -126,6 +344,7 @@ unsigned long sbi_ngets(char *str, unsigned long len)
 #define va_start(v, l) __builtin_va_start((v), l)
 #define va_end __builtin_va_end
 #define va_arg __builtin_va_arg
+#define va_copy __builtin_va_copy
 typedef __builtin_va_list va_list;
 
 static void printc(char **out, u32 *out_len, char ch, int flags)
@@ -421,16 +640,42 @@ int sbi_snprintf(char *out, u32 out_sz, const char *format, ...)
 	return retval;
 }
 
+static int console_vprintf(const char *format, va_list args)
+{
+	int retval;
+#ifdef CONFIG_SBI_CONSOLE_BUFFERED
+	char buf[CONSOLE_TBUF_MAX], *out = buf;
+	u32 out_len = sizeof(buf);
+	va_list bargs;
+
+	if (console_buffered) {
+		va_copy(bargs, args);
+		retval = print(&out, &out_len, format, bargs);
+		va_end(bargs);
+		if (retval < (int)sizeof(buf) &&
+		    console_ring_write(buf, retval))
+			return retval;
+
+		/* Too long for the ring, write it after pending messages */
+		console_drain(true);
+	}
+#endif
+
+	spin_lock(&console_out_lock);
+	retval = print(NULL, NULL, format, args);
+	spin_unlock(&console_out_lock);
+
+	return retval;
+}
+
 int sbi_printf(const char *format, ...)
 {
 	va_list args;
 	int retval;
 
-	spin_lock(&console_out_lock);
 	va_start(args, format);
-	retval = print(NULL, NULL, format, args);
+	retval = console_vprintf(format, args);
 	va_end(args);
-	spin_unlock(&console_out_lock);
 
 	return retval;
 }
@@ -442,11 +687,8 @@ int sbi_dprintf(const char *format, ...)
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 
 	va_start(args, format);
-	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS) {
-		spin_lock(&console_out_lock);
-		retval = print(NULL, NULL, format, args);
-		spin_unlock(&console_out_lock);
-	}
+	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS)
+		retval = console_vprintf(format, args);
 	va_end(args);
 
 	return retval;
@@ -456,6 +698,9 @@ void sbi_panic(const char *format, ...)
 {
 	va_list args;
 
+	/* Write pending messages first, then the panic synchronously */
+	sbi_console_flush();
+
 	spin_lock(&console_out_lock);
 	va_start(args, format);
 	print(NULL, NULL, format, args);
@@ -485,6 +730,8 @@ int sbi_console_init(struct sbi_scratch *scratch)
 	/* console is not a necessary device */
 	if (rc == SBI_ENODEV)
 		return 0;
+	if (rc)
+		return rc;
 
-	return rc;
+	return console_ring_init();
 }
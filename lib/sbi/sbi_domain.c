@@ -40,6 +40,20 @@ struct sbi_domain root = {
 
 static unsigned long domain_hart_ptr_offset;
 
+/** Address range [start, next start) with the same first matching region */
+struct sbi_domain_region_range {
+	unsigned long start;
+	const struct sbi_domain_memregion *reg;
+};
+
+/** Per-HART cache of the last region index hit */
+struct domain_region_cache {
+	const struct sbi_domain *dom;
+	u32 pos;
+};
+
+static unsigned long domain_region_cache_offset;
+
 struct sbi_domain *sbi_hartindex_to_domain(u32 hartindex)
 {
 	struct sbi_scratch *scratch;
@@ -111,17 +125,84 @@ void sbi_domain_memregion_init(unsigned long addr,
 	}
 }
 
-bool sbi_domain_check_addr(const struct sbi_domain *dom,
-			   unsigned long addr, unsigned long mode,
-			   unsigned long access_flags)
+static const struct sbi_domain_memregion *find_region_linear(
+						const struct sbi_domain *dom,
+						unsigned long addr)
 {
-	bool rmmio, mmio = false;
+	unsigned long rstart, rend;
 	struct sbi_domain_memregion *reg;
-	unsigned long rstart, rend, rflags, rwx = 0, rrwx = 0;
 
-	if (!dom)
+	sbi_domain_for_each_memregion(dom, reg) {
+		rstart = reg->base;
+		rend = (reg->order < __riscv_xlen) ?
+			rstart + ((1UL << reg->order) - 1) : -1UL;
+		if (rstart <= addr && addr <= rend)
+			return reg;
+	}
+
+	return NULL;
+}
+
+static bool region_index_contains(const struct sbi_domain *dom, u32 pos,
+				  unsigned long addr)
+{
+	const struct sbi_domain_region_range *idx = dom->region_index;
+
+	if (pos >= dom->region_index_count || addr < idx[pos].start)
 		return false;
 
+	return (pos + 1 == dom->region_index_count) ||
+		(addr < idx[pos + 1].start);
+}
+
+static u32 region_index_lookup(const struct sbi_domain *dom,
+			       unsigned long addr)
+{
+	const struct sbi_domain_region_range *idx = dom->region_index;
+	struct domain_region_cache *cache = NULL;
+	u32 lo = 0, hi = dom->region_index_count - 1, mid;
+
+	if (domain_region_cache_offset) {
+		cache = sbi_scratch_thishart_offset_ptr(
+					domain_region_cache_offset);
+		if (cache->dom == dom &&
+		    region_index_contains(dom, cache->pos, addr))
+			return cache->pos;
+	}
+
+	/* First range always starts at zero so idx[lo].start <= addr */
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (idx[mid].start <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	if (cache) {
+		cache->dom = dom;
+		cache->pos = lo;
+	}
+
+	return lo;
+}
+
+static const struct sbi_domain_memregion *find_region(
+						const struct sbi_domain *dom,
+						unsigned long addr)
+{
+	if (dom->region_index)
+		return dom->region_index[region_index_lookup(dom, addr)].reg;
+
+	return find_region_linear(dom, addr);
+}
+
+static bool region_check_access(const struct sbi_domain_memregion *reg,
+				unsigned long mode, unsigned long access_flags)
+{
+	bool rmmio, mmio = false;
+	unsigned long rflags, rwx = 0, rrwx = 0;
+
 	/*
 	 * Use M_{R/W/X} bits because the SU-bits are at the
 	 * same relative offsets. If the mode is not M, the SU
@@ -139,23 +220,32 @@ bool sbi_domain_check_addr(const struct sbi_domain *dom,
 	if (access_flags & SBI_DOMAIN_MMIO)
 		mmio = true;
 
-	sbi_domain_for_each_memregion(dom, reg) {
-		rflags = reg->flags;
-		rrwx = (mode == PRV_M ?
-			(rflags & SBI_DOMAIN_MEMREGION_M_ACCESS_MASK) :
-			(rflags & SBI_DOMAIN_MEMREGION_SU_ACCESS_MASK)
-			>> SBI_DOMAIN_MEMREGION_SU_ACCESS_SHIFT);
+	rflags = reg->flags;
+	rrwx = (mode == PRV_M ?
+		(rflags & SBI_DOMAIN_MEMREGION_M_ACCESS_MASK) :
+		(rflags & SBI_DOMAIN_MEMREGION_SU_ACCESS_MASK)
+		>> SBI_DOMAIN_MEMREGION_SU_ACCESS_SHIFT);
 
-		rstart = reg->base;
-		rend = (reg->order < __riscv_xlen) ?
-			rstart + ((1UL << reg->order) - 1) : -1UL;
-		if (rstart <= addr && addr <= rend) {
-			rmmio = (rflags & SBI_DOMAIN_MEMREGION_MMIO) ? true : false;
-			if (mmio != rmmio)
-				return false;
-			return ((rrwx & rwx) == rwx) ? true : false;
-		}
-	}
+	rmmio = (rflags & SBI_DOMAIN_MEMREGION_MMIO) ? true : false;
+	if (mmio != rmmio)
+		return false;
+
+	return ((rrwx & rwx) == rwx) ? true : false;
+}
+
+bool sbi_domain_check_addr(const struct sbi_domain *dom,
+			   unsigned long addr, unsigned long mode,
+			   unsigned long access_flags)
+{
+	const struct sbi_domain_memregion *reg;
+
+	if (!dom)
+		return false;
+
+	/* Regions are sorted so the first match has priority */
+	reg = find_region(dom, addr);
+	if (reg)
+		return region_check_access(reg, mode, access_flags);
 
 	return (mode == PRV_M) ? true : false;
 }
@@ -217,24 +307,6 @@ static bool is_region_before(const struct sbi_domain_memregion *regA,
 	return false;
 }
 
-static const struct sbi_domain_memregion *find_region(
-						const struct sbi_domain *dom,
-						unsigned long addr)
-{
-	unsigned long rstart, rend;
-	struct sbi_domain_memregion *reg;
-
-	sbi_domain_for_each_memregion(dom, reg) {
-		rstart = reg->base;
-		rend = (reg->order < __riscv_xlen) ?
-			rstart + ((1UL << reg->order) - 1) : -1UL;
-		if (rstart <= addr && addr <= rend)
-			return reg;
-	}
-
-	return NULL;
-}
-
 static const struct sbi_domain_memregion *find_next_subset_region(
 				const struct sbi_domain *dom,
 				const struct sbi_domain_memregion *reg,
@@ -394,10 +466,27 @@ bool sbi_domain_check_addr_range(const struct sbi_domain *dom,
 {
 	unsigned long max = addr + size;
 	const struct sbi_domain_memregion *reg, *sreg;
+	u32 pos;
 
 	if (!dom)
 		return false;
 
+	/* Walk the index ranges covering [addr, max) */
+	if (dom->region_index) {
+		while (addr < max) {
+			pos = region_index_lookup(dom, addr);
+			reg = dom->region_index[pos].reg;
+			if (!reg || !region_check_access(reg, mode, access_flags))
+				return false;
+
+			if (pos + 1 == dom->region_index_count)
+				break;
+			addr = dom->region_index[pos + 1].start;
+		}
+
+		return true;
+	}
+
 	while (addr < max) {
 		reg = find_region(dom, addr);
 		if (!reg)
@@ -501,6 +590,16 @@ void sbi_domain_dump(const struct sbi_domain *dom, const char *suffix)
 
 	sbi_printf("Domain%d SysSuspend  %s: %s\n",
 		   dom->index, suffix, (dom->system_suspend_allowed) ? "yes" : "no");
+
+	if (dom->context_flags)
+		sbi_printf("Domain%d CtxIsolate  %s: %s%s%s\n",
+			   dom->index, suffix,
+			   (dom->context_flags & SBI_DOMAIN_CTX_ISOLATE_FP) ?
+			   "fp " : "",
+			   (dom->context_flags & SBI_DOMAIN_CTX_ISOLATE_VECTOR) ?
+			   "vector " : "",
+			   (dom->context_flags & SBI_DOMAIN_CTX_ISOLATE_HYP) ?
+			   "hypervisor" : "");
 }
 
 void sbi_domain_dump_all(const char *suffix)
@@ -672,6 +771,69 @@ int sbi_domain_root_add_memrange(unsigned long addr, unsigned long size,
 	return 0;
 }
 
+/*
+ * Split the address space at every region boundary. No boundary lies
+ * inside the resulting ranges, so the first matching region is the same
+ * for every address of a range and can be resolved once here.
+ */
+static int domain_build_region_index(struct sbi_domain *dom)
+{
+	struct sbi_domain_region_range *idx;
+	const struct sbi_domain_memregion *reg;
+	unsigned long *bounds, tmp;
+	u32 i, j, count = 0, nbounds = 0;
+
+	sbi_domain_for_each_memregion(dom, reg)
+		count++;
+
+	bounds = sbi_calloc(sizeof(*bounds), 2 * count + 1);
+	if (!bounds)
+		return SBI_ENOMEM;
+
+	bounds[nbounds++] = 0;
+	sbi_domain_for_each_memregion(dom, reg) {
+		bounds[nbounds++] = reg->base;
+		if (reg->order < __riscv_xlen)
+			bounds[nbounds++] = reg->base + BIT(reg->order);
+	}
+
+	/* Sort boundaries and drop duplicates */
+	for (i = 1; i < nbounds; i++) {
+		tmp = bounds[i];
+		for (j = i; j > 0 && bounds[j - 1] > tmp; j--)
+			bounds[j] = bounds[j - 1];
+		bounds[j] = tmp;
+	}
+	for (i = 1, j = 1; i < nbounds; i++) {
+		if (bounds[i] != bounds[j - 1])
+			bounds[j++] = bounds[i];
+	}
+	nbounds = j;
+
+	idx = sbi_calloc(sizeof(*idx), nbounds);
+	if (!idx) {
+		sbi_free(bounds);
+		return SBI_ENOMEM;
+	}
+
+	/* Merge neighbouring ranges resolving to the same region */
+	count = 0;
+	for (i = 0; i < nbounds; i++) {
+		reg = find_region_linear(dom, bounds[i]);
+		if (count && idx[count - 1].reg == reg)
+			continue;
+		idx[count].start = bounds[i];
+		idx[count].reg = reg;
+		count++;
+	}
+	sbi_free(bounds);
+
+	dom->region_index = idx;
+	dom->region_index_count = count;
+
+	return 0;
+}
+
 int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 {
 	int rc;
@@ -687,6 +849,16 @@ int sbi_domain_finalize(struct sbi_scratch *scratch, u32 cold_hartid)
 		return rc;
 	}
 
+	/* Build region lookup index of domains */
+	sbi_domain_for_each(i, dom) {
+		rc = domain_build_region_index(dom);
+		if (rc) {
+			sbi_printf("%s: %s region index failed (error %d)\n",
+				   __func__, dom->name, rc);
+			return rc;
+		}
+	}
+
 	/* Startup boot HART of domains */
 	sbi_domain_for_each(i, dom) {
 		/* Domain boot HART index */
@@ -762,10 +934,18 @@ int sbi_domain_init(struct sbi_scratch *scratch, u32 cold_hartid)
 		return SBI_EINVAL;
 	}
 
-	domain_hart_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+	domain_hart_ptr_offset = sbi_scratch_alloc_type_offset_flags(void *,
+					SBI_SCRATCH_ALLOC_LOCAL_HOT);
 	if (!domain_hart_ptr_offset)
 		return SBI_ENOMEM;
 
+	domain_region_cache_offset = sbi_scratch_alloc_offset(
+				sizeof(struct domain_region_cache));
+	if (!domain_region_cache_offset) {
+		rc = SBI_ENOMEM;
+		goto fail_free_domain_hart_ptr_offset;
+	}
+
 	root_memregs = sbi_calloc(sizeof(*root_memregs), ROOT_REGION_MAX + 1);
 	if (!root_memregs) {
 		sbi_printf("%s: no memory for root regions\n", __func__);
@@ -836,6 +1016,8 @@ fail_free_root_hmask:
 fail_free_root_memregs:
 	sbi_free(root_memregs);
 fail_free_domain_hart_ptr_offset:
+	if (domain_region_cache_offset)
+		sbi_scratch_free_offset(domain_region_cache_offset);
 	sbi_scratch_free_offset(domain_hart_ptr_offset);
 	return rc;
 }
@@ -7,18 +7,266 @@
 #include <sbi/sbi_error.h>
 #include <sbi/riscv_locks.h>
 #include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/riscv_fp.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_hsm.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_hfence.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_domain_context.h>
 
+/*
+ * Get the PMP image of a domain context, computing it on the first
+ * switch to the context.
+ */
+static const struct sbi_hart_pmp_image *
+domain_context_pmp_image(struct sbi_scratch *scratch, struct sbi_context *ctx)
+{
+	struct sbi_hart_pmp_image *img;
+
+	if (ctx->pmp)
+		return ctx->pmp;
+
+	img = sbi_zalloc(sizeof(*img));
+	if (!img)
+		return NULL;
+
+	if (sbi_hart_pmp_image_build(scratch, ctx->dom, img)) {
+		sbi_free(img);
+		return NULL;
+	}
+
+	ctx->pmp = img;
+	return img;
+}
+
+/*
+ * Supervisor software may keep live FP/vector state while FS/VS is Off
+ * (e.g. a kernel running on behalf of a user task) and marks state Clean
+ * relative to its own save area, so only Initial state is known to not
+ * need a save. Initial state is recorded as zeroes.
+ */
+#define state_needs_save(__mstatus, __field, __initial)		\
+	(((__mstatus) & (__field)) != (__initial))
+
+#ifdef __riscv_flen
+static void switch_fp_state(struct sbi_context *ctx,
+			    struct sbi_context *dom_ctx)
+{
+	/* Allow FP access in M-mode, mstatus is restored on trap exit */
+	csr_set(CSR_MSTATUS, MSTATUS_FS);
+
+	if (state_needs_save(ctx->regs.mstatus, MSTATUS_FS,
+			     MSTATUS_FS_INITIAL)) {
+		__sbi_fp_save(ctx->fp.f);
+		ctx->fp.fcsr = csr_read(CSR_FCSR);
+	} else {
+		sbi_memset(&ctx->fp, 0, sizeof(ctx->fp));
+	}
+
+	__sbi_fp_restore(dom_ctx->fp.f);
+	csr_write(CSR_FCSR, dom_ctx->fp.fcsr);
+}
+#endif
+
+static struct sbi_context_vector *context_vector(struct sbi_context *ctx,
+						 unsigned long vlenb)
+{
+	if (!ctx->vector)
+		ctx->vector = sbi_zalloc(sizeof(*ctx->vector) + 32 * vlenb);
+
+	return ctx->vector;
+}
+
+/*
+ * Whole register loads/stores of groups of eight vector registers using
+ * a0 as base address, encoded directly so that the firmware does not
+ * have to be built with the V extension.
+ */
+static void vector_save(struct sbi_context_vector *vec, unsigned long vlenb)
+{
+	register unsigned long base asm("a0") = (unsigned long)vec->v;
+	unsigned long step = 8 * vlenb;
+
+	vec->vstart = csr_read(CSR_VSTART);
+	vec->vcsr   = csr_read(CSR_VCSR);
+	vec->vl	    = csr_read(CSR_VL);
+	vec->vtype  = csr_read(CSR_VTYPE);
+	csr_write(CSR_VSTART, 0);
+
+	__asm__ __volatile__(".word 0xe2850027\n"	/* vs8r.v v0, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850427\n"	/* vs8r.v v8, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850827\n"	/* vs8r.v v16, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850c27\n"	/* vs8r.v v24, (a0) */
+			     : "+r"(base)
+			     : "r"(step)
+			     : "memory");
+}
+
+static void vector_restore(const struct sbi_context_vector *vec,
+			   unsigned long vlenb)
+{
+	register unsigned long base asm("a0") = (unsigned long)vec->v;
+	register unsigned long vl asm("a1") = vec->vl;
+	register unsigned long vtype asm("a2") = vec->vtype;
+	unsigned long step = 8 * vlenb;
+
+	csr_write(CSR_VSTART, 0);
+
+	__asm__ __volatile__(".word 0xe2850007\n"	/* vl8re8.v v0, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850407\n"	/* vl8re8.v v8, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850807\n"	/* vl8re8.v v16, (a0) */
+			     "add a0, a0, %1\n"
+			     ".word 0xe2850c07\n"	/* vl8re8.v v24, (a0) */
+			     ".word 0x80c5f057\n"	/* vsetvl x0, a1, a2 */
+			     : "+r"(base)
+			     : "r"(step), "r"(vl), "r"(vtype)
+			     : "memory");
+
+	csr_write(CSR_VSTART, vec->vstart);
+	csr_write(CSR_VCSR, vec->vcsr);
+}
+
+static void switch_vector_state(struct sbi_context *ctx,
+				struct sbi_context *dom_ctx)
+{
+	struct sbi_context_vector *cur, *next;
+	unsigned long vlenb;
+
+	/* Allow vector access in M-mode, mstatus is restored on trap exit */
+	csr_set(CSR_MSTATUS, MSTATUS_VS);
+	vlenb = csr_read(CSR_VLENB);
+
+	cur = context_vector(ctx, vlenb);
+	next = context_vector(dom_ctx, vlenb);
+	if (!cur || !next) {
+		sbi_printf("%s: no memory for vector state of domain %s\n",
+			   __func__, (!cur) ? ctx->dom->name : dom_ctx->dom->name);
+		return;
+	}
+
+	if (state_needs_save(ctx->regs.mstatus, MSTATUS_VS,
+			     MSTATUS_VS_INITIAL))
+		vector_save(cur, vlenb);
+	else
+		sbi_memset(cur, 0, sizeof(*cur) + 32 * vlenb);
+
+	vector_restore(next, vlenb);
+}
+
+/* Swap a 64-bit CSR, split into a low and a high half on RV32 */
+#if __riscv_xlen == 32
+#define csr_swap_u64(__csr, __csrh, __val)				\
+	({								\
+		u64 __old = csr_read(__csr) |				\
+			    ((u64)csr_read(__csrh) << 32);		\
+		csr_write(__csr, (u32)(__val));				\
+		csr_write(__csrh, (u32)((__val) >> 32));		\
+		__old;							\
+	})
+#else
+#define csr_swap_u64(__csr, __csrh, __val)	csr_swap(__csr, __val)
+#endif
+
+static void switch_hyp_state(struct sbi_scratch *scratch,
+			     struct sbi_context *ctx,
+			     struct sbi_context *dom_ctx)
+{
+	struct sbi_context_hyp *cur = &ctx->hyp, *next = &dom_ctx->hyp;
+
+	cur->hstatus	= csr_swap(CSR_HSTATUS, next->hstatus);
+	cur->hedeleg	= csr_swap(CSR_HEDELEG, next->hedeleg);
+	cur->hideleg	= csr_swap(CSR_HIDELEG, next->hideleg);
+	cur->hie	= csr_swap(CSR_HIE, next->hie);
+	cur->hvip	= csr_swap(CSR_HVIP, next->hvip);
+	cur->hcounteren = csr_swap(CSR_HCOUNTEREN, next->hcounteren);
+	cur->hgeie	= csr_swap(CSR_HGEIE, next->hgeie);
+	cur->htval	= csr_swap(CSR_HTVAL, next->htval);
+	cur->htinst	= csr_swap(CSR_HTINST, next->htinst);
+	cur->hgatp	= csr_swap(CSR_HGATP, next->hgatp);
+	cur->htimedelta = csr_swap_u64(CSR_HTIMEDELTA, CSR_HTIMEDELTAH,
+				       next->htimedelta);
+
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_12)
+		cur->henvcfg = csr_swap_u64(CSR_HENVCFG, CSR_HENVCFGH,
+					    next->henvcfg);
+
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SMSTATEEN)) {
+		cur->hstateen[0] = csr_swap_u64(CSR_HSTATEEN0, CSR_HSTATEEN0H,
+						next->hstateen[0]);
+		cur->hstateen[1] = csr_swap_u64(CSR_HSTATEEN1, CSR_HSTATEEN1H,
+						next->hstateen[1]);
+		cur->hstateen[2] = csr_swap_u64(CSR_HSTATEEN2, CSR_HSTATEEN2H,
+						next->hstateen[2]);
+		cur->hstateen[3] = csr_swap_u64(CSR_HSTATEEN3, CSR_HSTATEEN3H,
+						next->hstateen[3]);
+	}
+
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SMAIA)) {
+		cur->hvien	= csr_swap(CSR_HVIEN, next->hvien);
+		cur->hvictl	= csr_swap(CSR_HVICTL, next->hvictl);
+		cur->hviprio1	= csr_swap_u64(CSR_HVIPRIO1, CSR_HVIPRIO1H,
+					       next->hviprio1);
+		cur->hviprio2	= csr_swap_u64(CSR_HVIPRIO2, CSR_HVIPRIO2H,
+					       next->hviprio2);
+	}
+
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSTC))
+		cur->vstimecmp = csr_swap_u64(CSR_VSTIMECMP, CSR_VSTIMECMPH,
+					      next->vstimecmp);
+
+	cur->vsstatus	= csr_swap(CSR_VSSTATUS, next->vsstatus);
+	cur->vsie	= csr_swap(CSR_VSIE, next->vsie);
+	cur->vstvec	= csr_swap(CSR_VSTVEC, next->vstvec);
+	cur->vsscratch	= csr_swap(CSR_VSSCRATCH, next->vsscratch);
+	cur->vsepc	= csr_swap(CSR_VSEPC, next->vsepc);
+	cur->vscause	= csr_swap(CSR_VSCAUSE, next->vscause);
+	cur->vstval	= csr_swap(CSR_VSTVAL, next->vstval);
+	cur->vsip	= csr_swap(CSR_VSIP, next->vsip);
+	cur->vsatp	= csr_swap(CSR_VSATP, next->vsatp);
+
+	/* Both domains may use the same VMIDs */
+	if (cur->hgatp != next->hgatp)
+		__sbi_hfence_gvma_all();
+}
+
+/*
+ * Switch the state classes isolated by either domain, each only when
+ * the HART implements it.
+ */
+static void switch_isolated_state(struct sbi_scratch *scratch,
+				  struct sbi_context *ctx,
+				  struct sbi_context *dom_ctx)
+{
+	unsigned long flags = ctx->dom->context_flags |
+			      dom_ctx->dom->context_flags;
+
+	if (!flags)
+		return;
+
+#ifdef __riscv_flen
+	if ((flags & SBI_DOMAIN_CTX_ISOLATE_FP) && misa_extension('D'))
+		switch_fp_state(ctx, dom_ctx);
+#endif
+	if ((flags & SBI_DOMAIN_CTX_ISOLATE_VECTOR) && misa_extension('V'))
+		switch_vector_state(ctx, dom_ctx);
+	if ((flags & SBI_DOMAIN_CTX_ISOLATE_HYP) && misa_extension('H'))
+		switch_hyp_state(scratch, ctx, dom_ctx);
+}
+
 /**
  * Switches the HART context from the current domain to the target domain.
  * This includes changing domain assignments and reconfiguring PMP, as well
- * as saving and restoring CSRs and trap states.
+ * as saving and restoring CSRs, trap states and the FP, vector and
+ * hypervisor states isolated by either domain.
  *
  * @param ctx pointer to the current HART context
  * @param dom_ctx pointer to the target domain context
@@ -31,19 +279,27 @@ static void switch_to_next_domain_context(struct sbi_context *ctx,
 	struct sbi_domain *dom	    = dom_ctx->dom;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 	unsigned int pmp_count	    = sbi_hart_pmp_count(scratch);
+	const struct sbi_hart_pmp_image *pmp;
 
 	/* Assign current hart to target domain */
-	hartindex = sbi_hartid_to_hartindex(current_hartid());
-	sbi_hartmask_clear_hartindex(
-		hartindex, &sbi_domain_thishart_ptr()->assigned_harts);
+	hartindex = ctx->hartindex;
+	sbi_hartmask_clear_hartindex(hartindex, &ctx->dom->assigned_harts);
 	sbi_update_hartindex_to_domain(hartindex, dom);
 	sbi_hartmask_set_hartindex(hartindex, &dom->assigned_harts);
 
-	/* Reconfigure PMP settings for the new domain */
-	for (int i = 0; i < pmp_count; i++) {
-		pmp_disable(i);
+	/*
+	 * Load the precomputed PMP image of the new domain, only entries
+	 * which differ from the current image are written.
+	 */
+	pmp = domain_context_pmp_image(scratch, dom_ctx);
+	if (pmp) {
+		sbi_hart_pmp_image_load(scratch, pmp);
+	} else {
+		for (int i = 0; i < pmp_count; i++) {
+			pmp_disable(i);
+		}
+		sbi_hart_pmp_configure(scratch);
 	}
-	sbi_hart_pmp_configure(scratch);
 
 	/* Save current CSR context and restore target domain's CSR context */
 	ctx->sstatus	= csr_swap(CSR_SSTATUS, dom_ctx->sstatus);
@@ -64,6 +320,9 @@ static void switch_to_next_domain_context(struct sbi_context *ctx,
 	sbi_memcpy(&ctx->regs, trap_regs, sizeof(*trap_regs));
 	sbi_memcpy(trap_regs, &dom_ctx->regs, sizeof(*trap_regs));
 
+	/* Switch FP, vector and hypervisor state isolated by the domains */
+	switch_isolated_state(scratch, ctx, dom_ctx);
+
 	/* Mark current context structure initialized because context saved */
 	ctx->initialized = true;
 
@@ -105,8 +364,14 @@ int sbi_domain_context_enter(struct sbi_domain *dom)
 	struct sbi_context *dom_ctx = sbi_hartindex_to_domain_context(
 		sbi_hartid_to_hartindex(current_hartid()), dom);
 
+	return sbi_domain_context_enter_ctx(ctx, dom_ctx);
+}
+
+int sbi_domain_context_enter_ctx(struct sbi_context *ctx,
+				 struct sbi_context *dom_ctx)
+{
 	/* Validate the domain context existence */
-	if (!dom_ctx)
+	if (!ctx || !dom_ctx)
 		return SBI_EINVAL;
 
 	/* Update target context's previous context to indicate the caller */
@@ -119,16 +384,26 @@ int sbi_domain_context_enter(struct sbi_domain *dom)
 
 int sbi_domain_context_exit(void)
 {
-	u32 i, hartindex = sbi_hartid_to_hartindex(current_hartid());
+	return sbi_domain_context_exit_ctx(sbi_domain_context_thishart_ptr());
+}
+
+int sbi_domain_context_exit_ctx(struct sbi_context *ctx)
+{
+	u32 i, hartindex;
 	struct sbi_domain *dom;
-	struct sbi_context *ctx	    = sbi_domain_context_thishart_ptr();
-	struct sbi_context *dom_ctx = ctx->prev_ctx, *tmp;
+	struct sbi_context *dom_ctx, *tmp;
+
+	if (!ctx)
+		return SBI_EINVAL;
+
+	hartindex = ctx->hartindex;
+	dom_ctx = ctx->prev_ctx;
 
 	/* If no previous caller context */
 	if (!dom_ctx) {
 		/* Try to find next uninitialized user-defined domain's context */
 		sbi_domain_for_each(i, dom) {
-			if (dom == &root || dom == sbi_domain_thishart_ptr())
+			if (dom == &root || dom == ctx->dom)
 				continue;
 
 			tmp = sbi_hartindex_to_domain_context(hartindex, dom);
@@ -164,6 +439,7 @@ int sbi_domain_context_init(struct sbi_scratch *scratch)
 
 			/* Bind context and domain */
 			dom_ctx->dom			   = dom;
+			dom_ctx->hartindex		   = j;
 			dom->hartindex_to_context_table[j] = dom_ctx;
 		}
 	}
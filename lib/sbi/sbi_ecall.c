@@ -11,6 +11,7 @@
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_trace.h>
 #include <sbi/sbi_trap.h>
 
 extern struct sbi_ecall_extension *sbi_ecall_exts[];
@@ -104,6 +105,9 @@ int sbi_ecall_handler(struct sbi_trap_regs *regs)
 	struct sbi_ecall_return out = {0};
 	bool is_0_1_spec = 0;
 
+	sbi_trace(SBI_TRACE_ECALL_ENTER, extension_id, func_id,
+		  regs->a0, regs->a1);
+
 	ext = sbi_ecall_find_extension(extension_id);
 	if (ext && ext->handle) {
 		ret = ext->handle(extension_id, func_id, regs, &out);
@@ -114,6 +118,9 @@ int sbi_ecall_handler(struct sbi_trap_regs *regs)
 		ret = SBI_ENOTSUPP;
 	}
 
+	sbi_trace(SBI_TRACE_ECALL_EXIT, extension_id, func_id,
+		  (long)ret, out.value);
+
 	if (!out.skip_regs_update) {
 		if (ret < SBI_LAST_ERR ||
 		    (extension_id != SBI_EXT_0_1_CONSOLE_GETCHAR &&
@@ -138,6 +145,12 @@ int sbi_ecall_handler(struct sbi_trap_regs *regs)
 			regs->a1 = out.value;
 	}
 
+	/*
+	 * The timer tick may never reach M-mode (e.g. with Sstc) so
+	 * also drain buffered console output on the way back.
+	 */
+	sbi_console_drain();
+
 	return 0;
 }
 
@@ -0,0 +1,85 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm_idle.h>
+#include <sbi/sbi_trace.h>
+#include <sbi/sbi_trap.h>
+
+static int sbi_ecall_fwdbg_handler(unsigned long extid, unsigned long funcid,
+				   struct sbi_trap_regs *regs,
+				   struct sbi_ecall_return *out)
+{
+	unsigned long heap_val;
+	u64 val;
+	int ret;
+
+	/* Statistics and traces cover all domains */
+	if (sbi_domain_thishart_ptr() != &root)
+		return SBI_EDENIED;
+
+	switch (funcid) {
+	/* a0: hartid, a1: idle state index, a2: enum sbi_hsm_idle_stat */
+	case SBI_EXT_FWDBG_HSM_IDLE_STAT:
+		ret = sbi_hsm_idle_get_stat(regs->a0, regs->a1, regs->a2, &val);
+		if (ret)
+			return ret;
+		out->value = val;
+		break;
+
+	/* Upper 32 bits of SBI_EXT_FWDBG_HSM_IDLE_STAT on RV32 */
+	case SBI_EXT_FWDBG_HSM_IDLE_STAT_HI:
+#if __riscv_xlen == 32
+		ret = sbi_hsm_idle_get_stat(regs->a0, regs->a1, regs->a2, &val);
+		if (ret)
+			return ret;
+		out->value = val >> 32;
+#else
+		out->value = 0;
+#endif
+		break;
+
+	/* a0: enum sbi_heap_stat */
+	case SBI_EXT_FWDBG_HEAP_STAT:
+		ret = sbi_heap_get_stat(regs->a0, &heap_val);
+		if (ret)
+			return ret;
+		out->value = heap_val;
+		break;
+
+	case SBI_EXT_FWDBG_LOCK_STAT_DUMP:
+		qspin_lock_stats_dump();
+		break;
+
+	case SBI_EXT_FWDBG_TRACE_DUMP:
+		sbi_trace_dump();
+		break;
+
+	default:
+		return SBI_ENOTSUPP;
+	}
+
+	return 0;
+}
+
+struct sbi_ecall_extension ecall_fwdbg;
+
+static int sbi_ecall_fwdbg_register_extensions(void)
+{
+	return sbi_ecall_register_extension(&ecall_fwdbg);
+}
+
+struct sbi_ecall_extension ecall_fwdbg = {
+	.extid_start		= SBI_EXT_FWDBG,
+	.extid_end		= SBI_EXT_FWDBG,
+	.register_extensions	= sbi_ecall_fwdbg_register_extensions,
+	.handle			= sbi_ecall_fwdbg_handler,
+};
@@ -7,6 +7,7 @@
  *   Atish Patra <atish.patra@wdc.com>
  */
 
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
@@ -23,6 +24,8 @@ static int sbi_ecall_pmu_handler(unsigned long extid, unsigned long funcid,
 {
 	int ret = 0;
 	uint64_t temp;
+	unsigned long smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
 
 	switch (funcid) {
 	case SBI_EXT_PMU_NUM_COUNTERS:
@@ -74,7 +77,10 @@ static int sbi_ecall_pmu_handler(unsigned long extid, unsigned long funcid,
 		ret = sbi_pmu_ctr_stop(regs->a0, regs->a1, regs->a2);
 		break;
 	case SBI_EXT_PMU_SNAPSHOT_SET_SHMEM:
-		/* fallthrough as OpenSBI doesn't support snapshot yet */
+		ret = sbi_pmu_snapshot_set_shmem(sbi_domain_thishart_ptr(),
+						 smode, regs->a0, regs->a1,
+						 regs->a2);
+		break;
 	default:
 		ret = SBI_ENOTSUPP;
 	}
@@ -82,11 +88,57 @@ static int sbi_ecall_pmu_handler(unsigned long extid, unsigned long funcid,
 	return ret;
 }
 
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+static int sbi_ecall_pmu_mux_handler(unsigned long extid, unsigned long funcid,
+				     struct sbi_trap_regs *regs,
+				     struct sbi_ecall_return *out)
+{
+	int ret;
+	uint64_t temp;
+
+	switch (funcid) {
+	case SBI_EXT_PMU_MUX_GET_TIME:
+		ret = sbi_pmu_ctr_mux_get_time(regs->a0, regs->a1, &temp);
+		out->value = temp;
+		break;
+	case SBI_EXT_PMU_MUX_GET_TIME_HI:
+#if __riscv_xlen == 32
+		ret = sbi_pmu_ctr_mux_get_time(regs->a0, regs->a1, &temp);
+		out->value = temp >> 32;
+#else
+		ret = 0;
+		out->value = 0;
+#endif
+		break;
+	default:
+		ret = SBI_ENOTSUPP;
+	}
+
+	return ret;
+}
+
+static struct sbi_ecall_extension ecall_pmu_mux = {
+	.extid_start		= SBI_EXT_PMU_MUX,
+	.extid_end		= SBI_EXT_PMU_MUX,
+	.handle			= sbi_ecall_pmu_mux_handler,
+};
+
+#endif
+
 struct sbi_ecall_extension ecall_pmu;
 
 static int sbi_ecall_pmu_register_extensions(void)
 {
-	return sbi_ecall_register_extension(&ecall_pmu);
+	int ret;
+
+	ret = sbi_ecall_register_extension(&ecall_pmu);
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+	if (!ret)
+		ret = sbi_ecall_register_extension(&ecall_pmu_mux);
+#endif
+
+	return ret;
 }
 
 struct sbi_ecall_extension ecall_pmu = {
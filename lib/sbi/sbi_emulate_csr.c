@@ -14,6 +14,7 @@
 #include <sbi/sbi_emulate_csr.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_timer.h>
 #include <sbi/sbi_trap.h>
@@ -54,6 +55,11 @@ int sbi_emulate_csr_read(int csr_num, struct sbi_trap_regs *regs,
 	bool virt = (regs->mstatus & MSTATUS_MPV) ? true : false;
 #endif
 
+	/* Multiplexed PMU counters are only visible to HS/S-mode */
+	if (prev_mode == PRV_S && !virt &&
+	    !sbi_pmu_ctr_mux_csr_read(csr_num, csr_val))
+		return 0;
+
 	switch (csr_num) {
 	case CSR_HTIMEDELTA:
 		if (prev_mode == PRV_S && !virt)
@@ -11,6 +11,7 @@
 #include <sbi/riscv_barrier.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_fp.h>
+#include <sbi/riscv_locks.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
@@ -30,6 +31,7 @@ extern void __sbi_expected_trap_hext(void);
 void (*sbi_hart_expected_trap)(void) = &__sbi_expected_trap;
 
 static unsigned long hart_features_offset;
+static unsigned long hart_pmp_loaded_offset;
 
 static void mstatus_init(struct sbi_scratch *scratch)
 {
@@ -336,8 +338,34 @@ static unsigned int sbi_hart_get_smepmp_flags(struct sbi_scratch *scratch,
 	return pmp_flags;
 }
 
+/*
+ * Program a PMP entry, or record it in the image when one is given so
+ * that the same region walk serves both sbi_hart_pmp_configure() and
+ * sbi_hart_pmp_image_build().
+ */
+static void hart_pmp_set(struct sbi_hart_pmp_image *img, unsigned int n,
+			 unsigned long prot, unsigned long addr,
+			 unsigned long log2len)
+{
+	unsigned int shift = (n % SBI_HART_PMPCFG_ENTRIES) * 8;
+	unsigned long cfg, pmpaddr;
+
+	if (!img) {
+		pmp_set(n, prot, addr, log2len);
+		return;
+	}
+
+	if (n >= PMP_COUNT || pmp_encode(prot, addr, log2len, &cfg, &pmpaddr))
+		return;
+
+	img->pmpaddr[n] = pmpaddr;
+	img->pmpcfg[n / SBI_HART_PMPCFG_ENTRIES] &= ~(0xffUL << shift);
+	img->pmpcfg[n / SBI_HART_PMPCFG_ENTRIES] |= cfg << shift;
+}
+
 static void sbi_hart_smepmp_set(struct sbi_scratch *scratch,
 				struct sbi_domain *dom,
+				struct sbi_hart_pmp_image *img,
 				struct sbi_domain_memregion *reg,
 				unsigned int pmp_idx,
 				unsigned int pmp_flags,
@@ -347,7 +375,7 @@ static void sbi_hart_smepmp_set(struct sbi_scratch *scratch,
 	unsigned long pmp_addr = reg->base >> PMP_SHIFT;
 
 	if (pmp_log2gran <= reg->order && pmp_addr < pmp_addr_max) {
-		pmp_set(pmp_idx, pmp_flags, reg->base, reg->order);
+		hart_pmp_set(img, pmp_idx, pmp_flags, reg->base, reg->order);
 	} else {
 		sbi_printf("Can not configure pmp for domain %s because"
 			   " memory region address 0x%lx or size 0x%lx "
@@ -357,22 +385,25 @@ static void sbi_hart_smepmp_set(struct sbi_scratch *scratch,
 }
 
 static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
+				     struct sbi_domain *dom,
+				     struct sbi_hart_pmp_image *img,
 				     unsigned int pmp_count,
 				     unsigned int pmp_log2gran,
 				     unsigned long pmp_addr_max)
 {
 	struct sbi_domain_memregion *reg;
-	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	unsigned int pmp_idx, pmp_flags;
 
 	/*
 	 * Set the RLB so that, we can write to PMP entries without
 	 * enforcement even if some entries are locked.
 	 */
-	csr_set(CSR_MSECCFG, MSECCFG_RLB);
+	if (!img)
+		csr_set(CSR_MSECCFG, MSECCFG_RLB);
 
-	/* Disable the reserved entry */
-	pmp_disable(SBI_SMEPMP_RESV_ENTRY);
+	/* Disable the reserved entry (always clear in an image) */
+	if (!img)
+		pmp_disable(SBI_SMEPMP_RESV_ENTRY);
 
 	/* Program M-only regions when MML is not set. */
 	pmp_idx = 0;
@@ -393,12 +424,13 @@ static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
 		if (!pmp_flags)
 			return 0;
 
-		sbi_hart_smepmp_set(scratch, dom, reg, pmp_idx++, pmp_flags,
-				    pmp_log2gran, pmp_addr_max);
+		sbi_hart_smepmp_set(scratch, dom, img, reg, pmp_idx++,
+				    pmp_flags, pmp_log2gran, pmp_addr_max);
 	}
 
 	/* Set the MML to enforce new encoding */
-	csr_set(CSR_MSECCFG, MSECCFG_MML);
+	if (!img)
+		csr_set(CSR_MSECCFG, MSECCFG_MML);
 
 	/* Program shared and SU-only regions */
 	pmp_idx = 0;
@@ -419,8 +451,8 @@ static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
 		if (!pmp_flags)
 			return 0;
 
-		sbi_hart_smepmp_set(scratch, dom, reg, pmp_idx++, pmp_flags,
-				    pmp_log2gran, pmp_addr_max);
+		sbi_hart_smepmp_set(scratch, dom, img, reg, pmp_idx++,
+				    pmp_flags, pmp_log2gran, pmp_addr_max);
 	}
 
 	/*
@@ -432,12 +464,13 @@ static int sbi_hart_smepmp_configure(struct sbi_scratch *scratch,
 }
 
 static int sbi_hart_oldpmp_configure(struct sbi_scratch *scratch,
+				     struct sbi_domain *dom,
+				     struct sbi_hart_pmp_image *img,
 				     unsigned int pmp_count,
 				     unsigned int pmp_log2gran,
 				     unsigned long pmp_addr_max)
 {
 	struct sbi_domain_memregion *reg;
-	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	unsigned int pmp_idx = 0;
 	unsigned int pmp_flags;
 	unsigned long pmp_addr;
@@ -464,7 +497,8 @@ static int sbi_hart_oldpmp_configure(struct sbi_scratch *scratch,
 
 		pmp_addr = reg->base >> PMP_SHIFT;
 		if (pmp_log2gran <= reg->order && pmp_addr < pmp_addr_max) {
-			pmp_set(pmp_idx++, pmp_flags, reg->base, reg->order);
+			hart_pmp_set(img, pmp_idx++, pmp_flags,
+				     reg->base, reg->order);
 		} else {
 			sbi_printf("Can not configure pmp for domain %s because"
 				   " memory region address 0x%lx or size 0x%lx "
@@ -519,27 +553,28 @@ int sbi_hart_unmap_saddr(void)
 	return pmp_disable(SBI_SMEPMP_RESV_ENTRY);
 }
 
-int sbi_hart_pmp_configure(struct sbi_scratch *scratch)
+static int hart_pmp_configure(struct sbi_scratch *scratch,
+			      struct sbi_domain *dom,
+			      struct sbi_hart_pmp_image *img)
 {
-	int rc;
 	unsigned int pmp_bits, pmp_log2gran;
 	unsigned int pmp_count = sbi_hart_pmp_count(scratch);
 	unsigned long pmp_addr_max;
 
-	if (!pmp_count)
-		return 0;
-
 	pmp_log2gran = sbi_hart_pmp_log2gran(scratch);
 	pmp_bits = sbi_hart_pmp_addrbits(scratch) - 1;
 	pmp_addr_max = (1UL << pmp_bits) | ((1UL << pmp_bits) - 1);
 
 	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
-		rc = sbi_hart_smepmp_configure(scratch, pmp_count,
-						pmp_log2gran, pmp_addr_max);
+		return sbi_hart_smepmp_configure(scratch, dom, img, pmp_count,
+						 pmp_log2gran, pmp_addr_max);
 	else
-		rc = sbi_hart_oldpmp_configure(scratch, pmp_count,
-						pmp_log2gran, pmp_addr_max);
+		return sbi_hart_oldpmp_configure(scratch, dom, img, pmp_count,
+						 pmp_log2gran, pmp_addr_max);
+}
 
+static void hart_pmp_flush(void)
+{
 	/*
 	 * As per section 3.7.2 of privileged specification v1.12,
 	 * virtual address translations can be speculatively performed
@@ -560,6 +595,79 @@ int sbi_hart_pmp_configure(struct sbi_scratch *scratch)
 		if (misa_extension('H'))
 			__sbi_hfence_gvma_all();
 	}
+}
+
+int sbi_hart_pmp_image_build(struct sbi_scratch *scratch,
+			     struct sbi_domain *dom,
+			     struct sbi_hart_pmp_image *img)
+{
+	sbi_memset(img, 0, sizeof(*img));
+
+	if (!sbi_hart_pmp_count(scratch))
+		return 0;
+
+	return hart_pmp_configure(scratch, dom, img);
+}
+
+void sbi_hart_pmp_image_load(struct sbi_scratch *scratch,
+			     const struct sbi_hart_pmp_image *img)
+{
+	unsigned int i, w, first, last;
+	unsigned int pmp_count = sbi_hart_pmp_count(scratch);
+	const struct sbi_hart_pmp_image *cur =
+		sbi_scratch_read_type(scratch, void *, hart_pmp_loaded_offset);
+	bool changed;
+
+	if (!pmp_count || cur == img)
+		return;
+
+	/* Entries may be locked, same as sbi_hart_smepmp_configure() */
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SMEPMP))
+		csr_set(CSR_MSECCFG, MSECCFG_RLB);
+
+	/*
+	 * Rewrite only the pmpcfg CSRs whose entries differ from the
+	 * image currently loaded. Entries of a changed pmpcfg are disabled
+	 * while their addresses are updated.
+	 */
+	for (w = 0; w * SBI_HART_PMPCFG_ENTRIES < pmp_count; w++) {
+		first = w * SBI_HART_PMPCFG_ENTRIES;
+		last = MIN(first + SBI_HART_PMPCFG_ENTRIES, pmp_count);
+
+		changed = !cur || cur->pmpcfg[w] != img->pmpcfg[w];
+		for (i = first; !changed && i < last; i++)
+			changed = cur->pmpaddr[i] != img->pmpaddr[i];
+		if (!changed)
+			continue;
+
+		csr_write_num(CSR_PMPCFG0 + w * (__riscv_xlen / 32), 0);
+		for (i = first; i < last; i++) {
+			if (!cur || cur->pmpaddr[i] != img->pmpaddr[i])
+				csr_write_num(CSR_PMPADDR0 + i,
+					      img->pmpaddr[i]);
+		}
+		csr_write_num(CSR_PMPCFG0 + w * (__riscv_xlen / 32),
+			      img->pmpcfg[w]);
+	}
+
+	sbi_scratch_write_type(scratch, void *, hart_pmp_loaded_offset, img);
+
+	hart_pmp_flush();
+}
+
+int sbi_hart_pmp_configure(struct sbi_scratch *scratch)
+{
+	int rc;
+
+	if (!sbi_hart_pmp_count(scratch))
+		return 0;
+
+	rc = hart_pmp_configure(scratch, sbi_domain_thishart_ptr(), NULL);
+
+	/* PMP no longer matches any image */
+	sbi_scratch_write_type(scratch, void *, hart_pmp_loaded_offset, NULL);
+
+	hart_pmp_flush();
 
 	return rc;
 }
@@ -638,6 +746,10 @@ bool sbi_hart_has_extension(struct sbi_scratch *scratch,
 	struct sbi_hart_features *hfeatures =
 			sbi_scratch_offset_ptr(scratch, hart_features_offset);
 
+	/* Nothing is known before hart features are allocated */
+	if (!hart_features_offset)
+		return false;
+
 	if (__test_bit(ext, hfeatures->extensions))
 		return true;
 	else
@@ -666,6 +778,9 @@ const struct sbi_hart_ext_data sbi_hart_ext[] = {
 	__SBI_HART_EXT_DATA(sdtrig, SBI_HART_EXT_SDTRIG),
 	__SBI_HART_EXT_DATA(smcsrind, SBI_HART_EXT_SMCSRIND),
 	__SBI_HART_EXT_DATA(smcdeleg, SBI_HART_EXT_SMCDELEG),
+	__SBI_HART_EXT_DATA(sscsrind, SBI_HART_EXT_SSCSRIND),
+	__SBI_HART_EXT_DATA(ssccfg, SBI_HART_EXT_SSCCFG),
+	__SBI_HART_EXT_DATA(zawrs, SBI_HART_EXT_ZAWRS),
 };
 
 /**
@@ -751,12 +866,128 @@ static int hart_mhpm_get_allowed_bits(void)
 	return num_bits;
 }
 
+#ifdef CONFIG_SBI_HART_FEATURES_CACHE
+
+#define HART_FEATURES_CACHE_SIZE	4
+
+/** Trap based probe results shared by harts with the same identity */
+struct hart_features_cache_entry {
+	bool valid;
+	unsigned long mvendorid;
+	unsigned long marchid;
+	unsigned long mimpid;
+	unsigned long misa;
+	unsigned long pmp_allowed_addr;
+	struct sbi_hart_features probed;
+};
+
+static struct hart_features_cache_entry
+		hart_features_cache[HART_FEATURES_CACHE_SIZE];
+static spinlock_t hart_features_cache_lock = SPIN_LOCK_INITIALIZER;
+
+static bool hart_features_cache_key(struct hart_features_cache_entry *key)
+{
+	key->mvendorid = csr_read(CSR_MVENDORID);
+	key->marchid = csr_read(CSR_MARCHID);
+	key->mimpid = csr_read(CSR_MIMPID);
+	key->misa = csr_read(CSR_MISA);
+
+	/* Harts without implementation IDs can't be told apart */
+	return key->mvendorid || key->marchid || key->mimpid;
+}
+
+static struct hart_features_cache_entry *
+hart_features_cache_find(const struct hart_features_cache_entry *key)
+{
+	struct hart_features_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < HART_FEATURES_CACHE_SIZE; i++) {
+		entry = &hart_features_cache[i];
+		if (entry->valid &&
+		    entry->mvendorid == key->mvendorid &&
+		    entry->marchid == key->marchid &&
+		    entry->mimpid == key->mimpid &&
+		    entry->misa == key->misa)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/*
+ * Fill trap based probe results from an identical hart. Only PMP address
+ * bits and MHPM counter width are probed again, to catch harts which
+ * share IDs but not the configuration.
+ */
+static bool hart_features_cache_lookup(struct sbi_hart_features *hfeatures,
+				       unsigned long pmp_allowed_addr)
+{
+	struct hart_features_cache_entry key, *entry;
+	bool found = false;
+
+	if (!hart_features_cache_key(&key))
+		return false;
+
+	spin_lock(&hart_features_cache_lock);
+	entry = hart_features_cache_find(&key);
+	if (entry && entry->pmp_allowed_addr == pmp_allowed_addr &&
+	    entry->probed.mhpm_bits == hart_mhpm_get_allowed_bits()) {
+		sbi_memcpy(hfeatures, &entry->probed, sizeof(*hfeatures));
+		found = true;
+	}
+	spin_unlock(&hart_features_cache_lock);
+
+	return found;
+}
+
+static void hart_features_cache_store(const struct sbi_hart_features *hfeatures,
+				      unsigned long pmp_allowed_addr)
+{
+	struct hart_features_cache_entry key, *entry;
+	int i;
+
+	if (!hart_features_cache_key(&key))
+		return;
+
+	spin_lock(&hart_features_cache_lock);
+	if (hart_features_cache_find(&key))
+		goto done;
+	for (i = 0; i < HART_FEATURES_CACHE_SIZE; i++) {
+		entry = &hart_features_cache[i];
+		if (entry->valid)
+			continue;
+		*entry = key;
+		entry->pmp_allowed_addr = pmp_allowed_addr;
+		sbi_memcpy(&entry->probed, hfeatures, sizeof(*hfeatures));
+		entry->valid = true;
+		break;
+	}
+done:
+	spin_unlock(&hart_features_cache_lock);
+}
+
+#else
+
+static bool hart_features_cache_lookup(struct sbi_hart_features *hfeatures,
+				       unsigned long pmp_allowed_addr)
+{
+	return false;
+}
+
+static void hart_features_cache_store(const struct sbi_hart_features *hfeatures,
+				      unsigned long pmp_allowed_addr)
+{
+}
+
+#endif
+
 static int hart_detect_features(struct sbi_scratch *scratch)
 {
 	struct sbi_trap_info trap = {0};
 	struct sbi_hart_features *hfeatures =
 		sbi_scratch_offset_ptr(scratch, hart_features_offset);
-	unsigned long val, oldval;
+	unsigned long val, oldval, pmp_allowed_addr;
 	bool has_zicntr = false;
 	int rc;
 
@@ -770,6 +1001,13 @@ static int hart_detect_features(struct sbi_scratch *scratch)
 	hfeatures->mhpm_mask = 0;
 	hfeatures->priv_version = SBI_HART_PRIV_VER_UNKNOWN;
 
+	/* Probed on every hart as it is part of the cache key */
+	pmp_allowed_addr = hart_pmp_get_allowed_addr();
+
+	/* Reuse trap based probing already done on an identical hart */
+	if (hart_features_cache_lookup(hfeatures, pmp_allowed_addr))
+		goto __probe_done;
+
 #define __check_hpm_csr(__csr, __mask) 					  \
 	oldval = csr_read_allowed(__csr, (ulong)&trap);			  \
 	if (!trap.cause) {						  \
@@ -834,7 +1072,7 @@ static int hart_detect_features(struct sbi_scratch *scratch)
 	 * Detect the allowed address bits & granularity. At least PMPADDR0
 	 * should be implemented.
 	 */
-	val = hart_pmp_get_allowed_addr();
+	val = pmp_allowed_addr;
 	if (val) {
 		hfeatures->pmp_log2gran = sbi_ffs(val) + 2;
 		hfeatures->pmp_addr_bits = sbi_fls(val) + 1;
@@ -913,6 +1151,15 @@ __pmp_skip:
 
 #undef __check_ext_csr
 
+	/* Detect if hart supports Zawrs (WRS.NTO without reservation) */
+	insn_exec_allowed(INSN_MATCH_WRS_NTO, (ulong)&trap);
+	if (!trap.cause)
+		__sbi_hart_update_extension(hfeatures, SBI_HART_EXT_ZAWRS,
+					    true);
+
+	hart_features_cache_store(hfeatures, pmp_allowed_addr);
+
+__probe_done:
 	/* Save trap based detection of Zicntr */
 	has_zicntr = sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICNTR);
 
@@ -982,6 +1229,10 @@ int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot)
 					sizeof(struct sbi_hart_features));
 		if (!hart_features_offset)
 			return SBI_ENOMEM;
+
+		hart_pmp_loaded_offset = sbi_scratch_alloc_type_offset(void *);
+		if (!hart_pmp_loaded_offset)
+			return SBI_ENOMEM;
 	}
 
 	rc = hart_detect_features(scratch);
@@ -993,6 +1244,9 @@ int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot)
 
 void __attribute__((noreturn)) sbi_hart_hang(void)
 {
+	/* Nothing will drain the console ring of a parked HART */
+	sbi_console_flush();
+
 	while (1)
 		wfi();
 	__builtin_unreachable();
@@ -7,7 +7,10 @@
  *   Anup Patel<apatel@ventanamicro.com>
  */
 
+#include <sbi/riscv_atomic.h>
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_list.h>
@@ -16,73 +19,477 @@
 
 /* Minimum size and alignment of heap allocations */
 #define HEAP_ALLOC_ALIGN		64
-#define HEAP_HOUSEKEEPING_FACTOR	16
 
-struct heap_node {
-	struct sbi_dlist head;
-	unsigned long addr;
+/*
+ * Small allocations are served from slabs. A slab is one heap granule
+ * of HEAP_SLAB_SIZE bytes holding objects of a single power-of-two size
+ * class (HEAP_ALLOC_ALIGN << class). Each slab is owned by one HART so
+ * the owner allocates and frees its objects without taking the heap
+ * lock, only refilling (a whole slab at a time) from the shared blocks.
+ *
+ * A slab is a block starting at a granule boundary, so its boundary
+ * tag takes the room of the first objects instead of a second granule.
+ */
+#define HEAP_SLAB_SIZE			HEAP_BASE_ALIGN
+#define HEAP_SLAB_CLASSES		SBI_HEAP_SLAB_CLASSES
+#define HEAP_SLAB_MAX_OBJ_SIZE		\
+	(HEAP_ALLOC_ALIGN << (HEAP_SLAB_CLASSES - 1))
+
+/*
+ * Larger allocations (and slabs) are blocks with a boundary tag in
+ * front of them, so that a block and its neighbours are found without
+ * searching any list.
+ */
+#define HEAP_BLOCK_HDR_SIZE		HEAP_ALLOC_ALIGN
+#define HEAP_BLOCK_MIN_SIZE		(HEAP_BLOCK_HDR_SIZE + HEAP_ALLOC_ALIGN)
+#define HEAP_BLOCK_USED			0x48454150UL
+
+/** Boundary tag of a heap block */
+struct heap_block {
+	/** Size of the block including the boundary tag */
 	unsigned long size;
+	/** Size of the previous block in address order (0 if none) */
+	unsigned long prev_size;
+	/** HEAP_BLOCK_USED when allocated, zero when free */
+	unsigned long used;
+	/** Link in the free block list (free blocks only) */
+	struct sbi_dlist head;
+};
+
+/** Per-HART slab cache */
+struct heap_hart {
+	/** Partial slabs owned by the HART for each size class */
+	struct sbi_dlist partial_slab_list[HEAP_SLAB_CLASSES];
+	/** Bytes of free objects in slabs owned by the HART */
+	atomic_t free_space;
+	/** Objects freed by other HARTs, linked through the objects */
+	atomic_t remote_free;
+	/** Serializes frees from other HARTs with offline changes */
+	spinlock_t remote_lock;
+	/** HART is stopped or suspended, others free into its slabs */
+	bool offline;
+};
+
+/** Descriptor of a heap granule used as slab */
+struct heap_slab {
+	/** Link in the partial slab list of the owner */
+	struct sbi_dlist head;
+	/** First free object */
+	void *free;
+	/** HART cache owning the slab */
+	struct heap_hart *owner;
+	/** Size of objects (zero when the granule is not a slab) */
+	unsigned short obj_size;
+	/** Number of allocated objects */
+	unsigned short inuse;
 };
 
 struct heap_control {
-	spinlock_t lock;
+	qspinlock_t lock;
 	unsigned long base;
 	unsigned long size;
 	unsigned long hkbase;
 	unsigned long hksize;
-	struct sbi_dlist free_node_list;
-	struct sbi_dlist free_space_list;
-	struct sbi_dlist used_space_list;
+	/** Bytes in free blocks */
+	unsigned long free_space;
+	/** Highest amount of bytes in used blocks */
+	unsigned long peak_used;
+	/** Number of failed allocations */
+	unsigned long failed_allocs;
+	/** Slab descriptors indexed by heap granule */
+	struct heap_slab *slabs;
+	struct sbi_dlist free_block_list;
 };
 
 static struct heap_control hpctrl;
 
-void *sbi_malloc(size_t size)
+/** Offset of the per-HART slab cache in scratch space */
+static unsigned long heap_hart_offset;
+
+#define heap_thishart_ptr()	\
+	((struct heap_hart *)sbi_scratch_thishart_offset_ptr(heap_hart_offset))
+
+static inline void *heap_block_payload(struct heap_block *b)
 {
-	void *ret = NULL;
-	struct heap_node *n, *np;
+	return (void *)((unsigned long)b + HEAP_BLOCK_HDR_SIZE);
+}
 
-	if (!size)
-		return NULL;
+static struct heap_block *heap_block_next(struct heap_block *b)
+{
+	unsigned long next = (unsigned long)b + b->size;
 
-	size += HEAP_ALLOC_ALIGN - 1;
-	size &= ~((unsigned long)HEAP_ALLOC_ALIGN - 1);
+	return (next < hpctrl.base + hpctrl.size) ?
+		(struct heap_block *)next : NULL;
+}
 
-	spin_lock(&hpctrl.lock);
+static struct heap_block *heap_block_prev(struct heap_block *b)
+{
+	return (b->prev_size) ?
+		(struct heap_block *)((unsigned long)b - b->prev_size) : NULL;
+}
 
-	np = NULL;
-	sbi_list_for_each_entry(n, &hpctrl.free_space_list, head) {
-		if (size <= n->size) {
-			np = n;
+/* Update size of a block along with the tag of the following block */
+static void heap_block_set_size(struct heap_block *b, unsigned long size)
+{
+	struct heap_block *next;
+
+	b->size = size;
+	next = heap_block_next(b);
+	if (next)
+		next->prev_size = size;
+}
+
+/*
+ * Allocate a block of given size (boundary tag included) such that the
+ * address skew bytes into the block has given alignment.
+ */
+static struct heap_block *heap_block_get(unsigned long size,
+					 unsigned long align,
+					 unsigned long skew)
+{
+	bool found = false;
+	struct heap_block *b, *n, *t;
+	unsigned long start, bstart, bend;
+
+	sbi_list_for_each_entry(b, &hpctrl.free_block_list, head) {
+		bstart = (unsigned long)b;
+		bend = bstart + b->size;
+		start = ROUNDUP(bstart + skew, align) - skew;
+		/* A leading fragment must be able to hold a block */
+		if (start != bstart && (start - bstart) < HEAP_BLOCK_MIN_SIZE)
+			start += align;
+		if (start + size <= bend) {
+			found = true;
 			break;
 		}
 	}
-	if (np) {
-		if ((size < np->size) &&
-		    !sbi_list_empty(&hpctrl.free_node_list)) {
-			n = sbi_list_first_entry(&hpctrl.free_node_list,
-						 struct heap_node, head);
-			sbi_list_del(&n->head);
-			n->addr = np->addr + np->size - size;
-			n->size = size;
-			np->size -= size;
-			sbi_list_add_tail(&n->head, &hpctrl.used_space_list);
-			ret = (void *)n->addr;
-		} else if (size == np->size) {
-			sbi_list_del(&np->head);
-			sbi_list_add_tail(&np->head, &hpctrl.used_space_list);
-			ret = (void *)np->addr;
+	if (!found)
+		return NULL;
+
+	if (start != bstart) {
+		/* Leading fragment stays in the free block list */
+		n = (struct heap_block *)start;
+		heap_block_set_size(b, start - bstart);
+		heap_block_set_size(n, bend - start);
+	} else {
+		sbi_list_del(&b->head);
+		n = b;
+	}
+
+	if ((n->size - size) >= HEAP_BLOCK_MIN_SIZE) {
+		t = (struct heap_block *)((unsigned long)n + size);
+		t->used = 0;
+		t->prev_size = size;
+		heap_block_set_size(t, n->size - size);
+		n->size = size;
+		sbi_list_add(&t->head, &hpctrl.free_block_list);
+	}
+
+	n->used = HEAP_BLOCK_USED;
+	hpctrl.free_space -= n->size;
+	if (hpctrl.peak_used < (hpctrl.size - hpctrl.hksize - hpctrl.free_space))
+		hpctrl.peak_used = hpctrl.size - hpctrl.hksize - hpctrl.free_space;
+
+	return n;
+}
+
+/* Allocate a block whose payload has given size and alignment */
+static void *heap_block_alloc(unsigned long size, unsigned long align)
+{
+	struct heap_block *b;
+
+	b = heap_block_get(size + HEAP_BLOCK_HDR_SIZE, align,
+			   HEAP_BLOCK_HDR_SIZE);
+
+	return (b) ? heap_block_payload(b) : NULL;
+}
+
+static void heap_block_free(struct heap_block *b)
+{
+	struct heap_block *prev, *next;
+
+	b->used = 0;
+	hpctrl.free_space += b->size;
+
+	next = heap_block_next(b);
+	if (next && !next->used) {
+		sbi_list_del(&next->head);
+		heap_block_set_size(b, b->size + next->size);
+	}
+
+	prev = heap_block_prev(b);
+	if (prev && !prev->used) {
+		heap_block_set_size(prev, prev->size + b->size);
+		return;
+	}
+
+	sbi_list_add(&b->head, &hpctrl.free_block_list);
+}
+
+static inline struct heap_slab *heap_slab_of(unsigned long addr)
+{
+	return &hpctrl.slabs[(addr - hpctrl.base) / HEAP_SLAB_SIZE];
+}
+
+static inline unsigned long heap_slab_addr(struct heap_slab *s)
+{
+	return hpctrl.base + (s - hpctrl.slabs) * HEAP_SLAB_SIZE;
+}
+
+/* Only the owner HART updates its free space, other HARTs just read it */
+static inline void heap_hart_add_free(struct heap_hart *hh, long delta)
+{
+	atomic_write(&hh->free_space, atomic_read(&hh->free_space) + delta);
+}
+
+/* Bytes of objects of given size held by one slab */
+static inline unsigned long heap_slab_capacity(unsigned long obj_size)
+{
+	return ((HEAP_SLAB_SIZE - HEAP_BLOCK_HDR_SIZE) / obj_size) * obj_size;
+}
+
+static void *heap_slab_alloc(struct heap_hart *hh, unsigned int cls)
+{
+	struct sbi_dlist *list = &hh->partial_slab_list[cls];
+	unsigned long addr, obj_size = HEAP_ALLOC_ALIGN << cls;
+	struct heap_slab *s;
+	void *obj;
+
+	if (sbi_list_empty(list)) {
+		qspin_lock(&hpctrl.lock);
+		addr = (unsigned long)heap_block_get(HEAP_SLAB_SIZE,
+						     HEAP_SLAB_SIZE, 0);
+		qspin_unlock(&hpctrl.lock);
+		if (!addr)
+			return NULL;
+
+		s = heap_slab_of(addr);
+		s->owner = hh;
+		s->obj_size = obj_size;
+		s->inuse = 0;
+		s->free = NULL;
+		for (obj = (void *)(addr + HEAP_SLAB_SIZE - obj_size);
+		     (unsigned long)obj >= addr + HEAP_BLOCK_HDR_SIZE;
+		     obj -= obj_size) {
+			*(void **)obj = s->free;
+			s->free = obj;
 		}
+		heap_hart_add_free(hh, heap_slab_capacity(obj_size));
+		sbi_list_add(&s->head, list);
+	}
+
+	s = sbi_list_first_entry(list, struct heap_slab, head);
+	obj = s->free;
+	s->free = *(void **)obj;
+	s->inuse++;
+	if (!s->free)
+		sbi_list_del_init(&s->head);
+	heap_hart_add_free(hh, -obj_size);
+
+	return obj;
+}
+
+/* Free an object of a slab owned by the current HART */
+static void heap_slab_free(struct heap_hart *hh, struct heap_slab *s,
+			   void *obj)
+{
+	struct sbi_dlist *list =
+		&hh->partial_slab_list[sbi_fls(s->obj_size / HEAP_ALLOC_ALIGN)];
+
+	if (!s->free)
+		sbi_list_add(&s->head, list);
+	*(void **)obj = s->free;
+	s->free = obj;
+	s->inuse--;
+	heap_hart_add_free(hh, s->obj_size);
+
+	/* Give empty slabs back unless it is the last one of its class */
+	if (!s->inuse && (list->next != &s->head || list->prev != &s->head)) {
+		sbi_list_del(&s->head);
+		heap_hart_add_free(hh, -heap_slab_capacity(s->obj_size));
+		s->obj_size = 0;
+		s->free = NULL;
+		s->owner = NULL;
+		qspin_lock(&hpctrl.lock);
+		heap_block_free((struct heap_block *)heap_slab_addr(s));
+		qspin_unlock(&hpctrl.lock);
 	}
+}
+
+/* Free objects handed back by other HARTs */
+static void heap_hart_drain(struct heap_hart *hh)
+{
+	void *obj, *next;
+
+	if (!atomic_read(&hh->remote_free))
+		return;
+
+	obj = (void *)atomic_xchg(&hh->remote_free, 0);
+	while (obj) {
+		next = *(void **)obj;
+		heap_slab_free(hh, heap_slab_of((unsigned long)obj), obj);
+		obj = next;
+	}
+}
+
+/* Hand an object back to the HART owning its slab */
+static void heap_slab_remote_free(struct heap_hart *owner, void *obj)
+{
+	long old;
 
-	spin_unlock(&hpctrl.lock);
+	spin_lock(&owner->remote_lock);
+
+	/* Nobody would drain the queue of an offline HART */
+	if (owner->offline) {
+		heap_slab_free(owner, heap_slab_of((unsigned long)obj), obj);
+		spin_unlock(&owner->remote_lock);
+		return;
+	}
+
+	do {
+		old = atomic_read(&owner->remote_free);
+		*(void **)obj = (void *)old;
+	} while (atomic_cmpxchg(&owner->remote_free, old, (long)obj) != old);
+
+	spin_unlock(&owner->remote_lock);
+}
+
+void sbi_heap_hart_offline(void)
+{
+	struct heap_hart *hh;
+
+	if (!heap_hart_offset)
+		return;
+
+	hh = heap_thishart_ptr();
+	spin_lock(&hh->remote_lock);
+	hh->offline = true;
+	heap_hart_drain(hh);
+	spin_unlock(&hh->remote_lock);
+}
+
+void sbi_heap_hart_online(void)
+{
+	struct heap_hart *hh;
+
+	if (!heap_hart_offset)
+		return;
+
+	hh = heap_thishart_ptr();
+	spin_lock(&hh->remote_lock);
+	hh->offline = false;
+	spin_unlock(&hh->remote_lock);
+}
+
+#ifdef CONFIG_SBI_HEAP_TRACK_CALLERS
+
+#define HEAP_TRACK_CALLERS_MAX		32
+
+/** Allocations made from one call site */
+struct heap_caller {
+	unsigned long addr;
+	unsigned long count;
+	unsigned long bytes;
+};
+
+static struct heap_caller heap_callers[HEAP_TRACK_CALLERS_MAX];
+static unsigned long heap_callers_dropped;
+static spinlock_t heap_callers_lock = SPIN_LOCK_INITIALIZER;
+
+static void heap_track_caller(unsigned long caller, size_t size)
+{
+	struct heap_caller *hc = NULL;
+	int i;
+
+	spin_lock(&heap_callers_lock);
+
+	for (i = 0; i < HEAP_TRACK_CALLERS_MAX; i++) {
+		if (heap_callers[i].addr == caller || !heap_callers[i].addr) {
+			hc = &heap_callers[i];
+			break;
+		}
+	}
+
+	if (hc) {
+		hc->addr = caller;
+		hc->count++;
+		hc->bytes += size;
+	} else {
+		heap_callers_dropped++;
+	}
+
+	spin_unlock(&heap_callers_lock);
+}
+
+void sbi_heap_dump_callers(void)
+{
+	int i;
+
+	spin_lock(&heap_callers_lock);
+
+	for (i = 0; i < HEAP_TRACK_CALLERS_MAX && heap_callers[i].addr; i++)
+		sbi_printf("Firmware Heap Caller      : 0x%lx %lu allocs, "
+			   "%lu B\n", heap_callers[i].addr,
+			   heap_callers[i].count, heap_callers[i].bytes);
+	if (heap_callers_dropped)
+		sbi_printf("Firmware Heap Caller      : %lu allocs untracked\n",
+			   heap_callers_dropped);
+
+	spin_unlock(&heap_callers_lock);
+}
+
+#else
+
+static inline void heap_track_caller(unsigned long caller, size_t size) { }
+
+void sbi_heap_dump_callers(void) { }
+
+#endif
+
+static void *heap_malloc(size_t size, unsigned long caller)
+{
+	struct heap_hart *hh;
+	void *ret = NULL;
+	unsigned int cls;
+
+	if (!size)
+		return NULL;
+
+	heap_track_caller(caller, size);
+
+	size += HEAP_ALLOC_ALIGN - 1;
+	size &= ~((unsigned long)HEAP_ALLOC_ALIGN - 1);
+
+	if (size <= HEAP_SLAB_MAX_OBJ_SIZE) {
+		cls = sbi_fls(size / HEAP_ALLOC_ALIGN);
+		if ((HEAP_ALLOC_ALIGN << cls) < size)
+			cls++;
+		hh = heap_thishart_ptr();
+		heap_hart_drain(hh);
+		ret = heap_slab_alloc(hh, cls);
+		if (ret)
+			return ret;
+	}
+
+	qspin_lock(&hpctrl.lock);
+	ret = heap_block_alloc(size, HEAP_ALLOC_ALIGN);
+	if (!ret)
+		hpctrl.failed_allocs++;
+	qspin_unlock(&hpctrl.lock);
 
 	return ret;
 }
 
+void *sbi_malloc(size_t size)
+{
+	return heap_malloc(size,
+			   (unsigned long)__builtin_return_address(0));
+}
+
 void *sbi_zalloc(size_t size)
 {
-	void *ret = sbi_malloc(size);
+	void *ret = heap_malloc(size,
+				(unsigned long)__builtin_return_address(0));
 
 	if (ret)
 		sbi_memset(ret, 0, size);
@@ -91,61 +498,61 @@ void *sbi_zalloc(size_t size)
 
 void sbi_free(void *ptr)
 {
-	struct heap_node *n, *np;
+	unsigned long addr = (unsigned long)ptr;
+	struct heap_block *b;
+	struct heap_hart *hh;
+	struct heap_slab *s;
 
 	if (!ptr)
 		return;
 
-	spin_lock(&hpctrl.lock);
-
-	np = NULL;
-	sbi_list_for_each_entry(n, &hpctrl.used_space_list, head) {
-		if ((n->addr <= (unsigned long)ptr) &&
-		    ((unsigned long)ptr < (n->addr + n->size))) {
-			np = n;
-			break;
-		}
-	}
-	if (!np) {
-		spin_unlock(&hpctrl.lock);
+	if (addr < (hpctrl.hkbase + hpctrl.hksize + HEAP_BLOCK_HDR_SIZE) ||
+	    (hpctrl.base + hpctrl.size) <= addr ||
+	    (addr & (HEAP_ALLOC_ALIGN - 1)))
 		return;
-	}
 
-	sbi_list_del(&np->head);
+	s = heap_slab_of(addr);
+	if (s->obj_size) {
+		if ((addr - heap_slab_addr(s)) < HEAP_BLOCK_HDR_SIZE ||
+		    (addr - heap_slab_addr(s)) % s->obj_size)
+			return;
 
-	sbi_list_for_each_entry(n, &hpctrl.free_space_list, head) {
-		if ((np->addr + np->size) == n->addr) {
-			n->addr = np->addr;
-			n->size += np->size;
-			sbi_list_add_tail(&np->head, &hpctrl.free_node_list);
-			np = NULL;
-			break;
-		} else if (np->addr == (n->addr + n->size)) {
-			n->size += np->size;
-			sbi_list_add_tail(&np->head, &hpctrl.free_node_list);
-			np = NULL;
-			break;
-		} else if ((n->addr + n->size) < np->addr) {
-			sbi_list_add(&np->head, &n->head);
-			np = NULL;
-			break;
+		hh = heap_thishart_ptr();
+		if (s->owner != hh) {
+			heap_slab_remote_free(s->owner, ptr);
+			return;
 		}
+		heap_hart_drain(hh);
+		heap_slab_free(hh, s, ptr);
+		return;
 	}
-	if (np)
-		sbi_list_add_tail(&np->head, &hpctrl.free_space_list);
 
-	spin_unlock(&hpctrl.lock);
+	qspin_lock(&hpctrl.lock);
+	b = (struct heap_block *)(addr - HEAP_BLOCK_HDR_SIZE);
+	if (b->used == HEAP_BLOCK_USED)
+		heap_block_free(b);
+	qspin_unlock(&hpctrl.lock);
 }
 
 unsigned long sbi_heap_free_space(void)
 {
-	struct heap_node *n;
-	unsigned long ret = 0;
-
-	spin_lock(&hpctrl.lock);
-	sbi_list_for_each_entry(n, &hpctrl.free_space_list, head)
-		ret += n->size;
-	spin_unlock(&hpctrl.lock);
+	struct sbi_scratch *rscratch;
+	struct heap_hart *hh;
+	unsigned long ret;
+	u32 i;
+
+	qspin_lock(&hpctrl.lock);
+	ret = hpctrl.free_space;
+	qspin_unlock(&hpctrl.lock);
+
+	/* Free objects in HART caches are sampled with atomic reads */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		hh = sbi_scratch_offset_ptr(rscratch, heap_hart_offset);
+		ret += atomic_read(&hh->free_space);
+	}
 
 	return ret;
 }
@@ -160,10 +567,58 @@ unsigned long sbi_heap_reserved_space(void)
 	return hpctrl.hksize;
 }
 
+int sbi_heap_get_stat(u32 stat, unsigned long *out_val)
+{
+	unsigned long val = 0;
+	struct heap_block *b;
+
+	if (!out_val)
+		return SBI_EINVAL;
+
+	switch (stat) {
+	case SBI_HEAP_STAT_TOTAL:
+		val = hpctrl.size;
+		break;
+	case SBI_HEAP_STAT_RESERVED:
+		val = sbi_heap_reserved_space();
+		break;
+	case SBI_HEAP_STAT_USED:
+		val = sbi_heap_used_space();
+		break;
+	case SBI_HEAP_STAT_FREE:
+		val = sbi_heap_free_space();
+		break;
+	case SBI_HEAP_STAT_PEAK:
+		val = hpctrl.peak_used;
+		break;
+	case SBI_HEAP_STAT_LARGEST_FREE:
+	case SBI_HEAP_STAT_FREE_BLOCKS:
+		qspin_lock(&hpctrl.lock);
+		sbi_list_for_each_entry(b, &hpctrl.free_block_list, head) {
+			if (stat == SBI_HEAP_STAT_FREE_BLOCKS)
+				val++;
+			else if (val < b->size - HEAP_BLOCK_HDR_SIZE)
+				val = b->size - HEAP_BLOCK_HDR_SIZE;
+		}
+		qspin_unlock(&hpctrl.lock);
+		break;
+	case SBI_HEAP_STAT_FAILED_ALLOCS:
+		val = hpctrl.failed_allocs;
+		break;
+	default:
+		return SBI_EINVAL;
+	}
+
+	*out_val = val;
+	return 0;
+}
+
 int sbi_heap_init(struct sbi_scratch *scratch)
 {
-	unsigned long i;
-	struct heap_node *n;
+	unsigned long i, j;
+	struct heap_block *b;
+	struct heap_hart *hh;
+	struct sbi_scratch *rscratch;
 
 	/* Sanity checks on heap offset and size */
 	if (!scratch->fw_heap_size ||
@@ -174,31 +629,48 @@ int sbi_heap_init(struct sbi_scratch *scratch)
 		return SBI_EINVAL;
 
 	/* Initialize heap control */
-	SPIN_LOCK_INIT(hpctrl.lock);
+	QSPIN_LOCK_INIT(hpctrl.lock);
+	qspin_lock_stats_register(&hpctrl.lock, "heap");
 	hpctrl.base = scratch->fw_start + scratch->fw_heap_offset;
 	hpctrl.size = scratch->fw_heap_size;
 	hpctrl.hkbase = hpctrl.base;
-	hpctrl.hksize = hpctrl.size / HEAP_HOUSEKEEPING_FACTOR;
-	hpctrl.hksize &= ~((unsigned long)HEAP_BASE_ALIGN - 1);
-	SBI_INIT_LIST_HEAD(&hpctrl.free_node_list);
-	SBI_INIT_LIST_HEAD(&hpctrl.free_space_list);
-	SBI_INIT_LIST_HEAD(&hpctrl.used_space_list);
-
-	/* Prepare free node list */
-	for (i = 0; i < (hpctrl.hksize / sizeof(*n)); i++) {
-		n = (struct heap_node *)(hpctrl.hkbase + (sizeof(*n) * i));
-		SBI_INIT_LIST_HEAD(&n->head);
-		n->addr = n->size = 0;
-		sbi_list_add_tail(&n->head, &hpctrl.free_node_list);
-	}
-
-	/* Prepare free space list */
-	n = sbi_list_first_entry(&hpctrl.free_node_list,
-				 struct heap_node, head);
-	sbi_list_del(&n->head);
-	n->addr = hpctrl.hkbase + hpctrl.hksize;
-	n->size = hpctrl.size - hpctrl.hksize;
-	sbi_list_add_tail(&n->head, &hpctrl.free_space_list);
+	hpctrl.hksize = (hpctrl.size / HEAP_SLAB_SIZE) * sizeof(*hpctrl.slabs);
+	hpctrl.hksize = ROUNDUP(hpctrl.hksize, HEAP_ALLOC_ALIGN);
+	if ((hpctrl.hksize + HEAP_BLOCK_MIN_SIZE) > hpctrl.size)
+		return SBI_EINVAL;
+	SBI_INIT_LIST_HEAD(&hpctrl.free_block_list);
+
+	/* Prepare per-HART slab caches */
+	heap_hart_offset = sbi_scratch_alloc_type_offset_flags(struct heap_hart,
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
+	if (!heap_hart_offset)
+		return SBI_ENOMEM;
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		hh = sbi_scratch_offset_ptr(rscratch, heap_hart_offset);
+		for (j = 0; j < HEAP_SLAB_CLASSES; j++)
+			SBI_INIT_LIST_HEAD(&hh->partial_slab_list[j]);
+		ATOMIC_INIT(&hh->free_space, 0);
+		ATOMIC_INIT(&hh->remote_free, 0);
+		SPIN_LOCK_INIT(hh->remote_lock);
+		hh->offline = false;
+	}
+
+	/* Prepare slab descriptors */
+	hpctrl.slabs = (struct heap_slab *)hpctrl.hkbase;
+	sbi_memset(hpctrl.slabs, 0, hpctrl.hksize);
+	for (i = 0; i < (hpctrl.size / HEAP_SLAB_SIZE); i++)
+		SBI_INIT_LIST_HEAD(&hpctrl.slabs[i].head);
+
+	/* Prepare the initial free block */
+	b = (struct heap_block *)(hpctrl.hkbase + hpctrl.hksize);
+	b->size = hpctrl.size - hpctrl.hksize;
+	b->prev_size = 0;
+	b->used = 0;
+	sbi_list_add_tail(&b->head, &hpctrl.free_block_list);
+	hpctrl.free_space = b->size;
 
 	return 0;
 }
@@ -18,13 +18,17 @@
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_idle.h>
 #include <sbi/sbi_init.h>
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_system.h>
 #include <sbi/sbi_timer.h>
+#include <sbi/sbi_trace.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_wait.h>
 
 #define __sbi_hsm_hart_change_state(hdata, oldstate, newstate)		\
 ({									\
@@ -32,6 +36,9 @@
 	if (state != (oldstate))					\
 		sbi_printf("%s: ERR: The hart is in invalid state [%lu]\n", \
 			   __func__, state);				\
+	else								\
+		sbi_trace(SBI_TRACE_HSM_STATE, (hdata)->hartid,		\
+			  oldstate, newstate, 0);			\
 	state == (oldstate);						\
 })
 
@@ -40,10 +47,12 @@ static unsigned long hart_data_offset;
 
 /** Per hart specific data to manage state transition **/
 struct sbi_hsm_data {
+	u32 hartid;
 	atomic_t state;
 	unsigned long suspend_type;
 	unsigned long saved_mie;
 	unsigned long saved_mip;
+	bool skip_device_resume;
 	atomic_t start_ticket;
 };
 
@@ -169,13 +178,14 @@ static void sbi_hsm_hart_wait(struct sbi_scratch *scratch, u32 hartid)
 	csr_set(CSR_MIE, MIP_MSIP | MIP_MEIP);
 
 	/* Wait for state transition requested by sbi_hsm_hart_start() */
-	while (atomic_read(&hdata->state) != SBI_HSM_STATE_START_PENDING) {
-		wfi();
-	}
+	sbi_wait_on_idle(&hdata->state.counter,
+			 VAL == SBI_HSM_STATE_START_PENDING);
 
 	/* Restore MIE CSR */
 	csr_write(CSR_MIE, saved_mie);
 
+	sbi_heap_hart_online();
+
 	/*
 	 * No need to clear IPI here because the sbi_ipi_init() will
 	 * clear it for current HART via sbi_platform_ipi_init().
@@ -243,7 +253,8 @@ int sbi_hsm_init(struct sbi_scratch *scratch, u32 hartid, bool cold_boot)
 	struct sbi_hsm_data *hdata;
 
 	if (cold_boot) {
-		hart_data_offset = sbi_scratch_alloc_offset(sizeof(*hdata));
+		hart_data_offset = sbi_scratch_alloc_offset_flags(sizeof(*hdata),
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
 		if (!hart_data_offset)
 			return SBI_ENOMEM;
 
@@ -255,6 +266,7 @@ int sbi_hsm_init(struct sbi_scratch *scratch, u32 hartid, bool cold_boot)
 
 			hdata = sbi_scratch_offset_ptr(rscratch,
 						       hart_data_offset);
+			hdata->hartid = sbi_hartindex_to_hartid(i);
 			ATOMIC_INIT(&hdata->state,
 				    (sbi_hartindex_to_hartid(i) == hartid) ?
 				    SBI_HSM_STATE_START_PENDING :
@@ -278,6 +290,9 @@ void __noreturn sbi_hsm_exit(struct sbi_scratch *scratch)
 					 SBI_HSM_STATE_STOPPED))
 		goto fail_exit;
 
+	/* Let other HARTs free objects of this HART while it is stopped */
+	sbi_heap_hart_offline();
+
 	if (hsm_device_has_hart_hotplug()) {
 		if (hsm_device_hart_stop() != SBI_ENOTSUPP)
 			goto fail_exit;
@@ -382,6 +397,9 @@ int sbi_hsm_hart_stop(struct sbi_scratch *scratch, bool exitnow)
 					 SBI_HSM_STATE_STOP_PENDING))
 		return SBI_EFAIL;
 
+	/* Write buffered console messages before going idle */
+	sbi_console_drain();
+
 	if (exitnow)
 		sbi_exit(scratch);
 
@@ -417,6 +435,7 @@ void __sbi_hsm_suspend_non_ret_save(struct sbi_scratch *scratch)
 
 	hdata->saved_mie = csr_read(CSR_MIE);
 	hdata->saved_mip = csr_read(CSR_MIP) & (MIP_SSIP | MIP_STIP);
+	hdata->skip_device_resume = false;
 }
 
 static void __sbi_hsm_suspend_non_ret_restore(struct sbi_scratch *scratch)
@@ -438,7 +457,11 @@ void sbi_hsm_hart_resume_start(struct sbi_scratch *scratch)
 					 SBI_HSM_STATE_RESUME_PENDING))
 		sbi_hart_hang();
 
-	hsm_device_hart_resume();
+	sbi_hsm_idle_exit(scratch);
+	sbi_heap_hart_online();
+
+	if (!hdata->skip_device_resume)
+		hsm_device_hart_resume();
 }
 
 void __noreturn sbi_hsm_hart_resume_finish(struct sbi_scratch *scratch,
@@ -467,6 +490,7 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 			 ulong raddr, ulong rmode, ulong arg1)
 {
 	int ret;
+	u32 enter_type;
 	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct sbi_hsm_data *hdata = sbi_scratch_offset_ptr(scratch,
 							    hart_data_offset);
@@ -475,6 +499,9 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 	if (!dom)
 		return SBI_EFAIL;
 
+	/* Write buffered console messages before going idle */
+	sbi_console_drain();
+
 	/* Sanity check on suspend type */
 	if (SBI_HSM_SUSPEND_RET_DEFAULT < suspend_type &&
 	    suspend_type < SBI_HSM_SUSPEND_RET_PLATFORM)
@@ -506,8 +533,15 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 					 SBI_HSM_STATE_SUSPENDED))
 		return SBI_EFAIL;
 
+	/*
+	 * Let the idle governor pick the suspend type actually entered.
+	 * It may differ from the requested one but never turns a
+	 * retentive request into a non-retentive suspend.
+	 */
+	enter_type = sbi_hsm_idle_select(scratch, suspend_type);
+
 	/* Save the suspend type */
-	hdata->suspend_type = suspend_type;
+	hdata->suspend_type = enter_type;
 
 	/*
 	 * Save context which will be restored after resuming from
@@ -516,16 +550,22 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 	if (suspend_type & SBI_HSM_SUSP_NON_RET_BIT)
 		__sbi_hsm_suspend_non_ret_save(scratch);
 
+	/* Let other HARTs free objects of this HART while it is suspended */
+	sbi_heap_hart_offline();
+
 	/* Try platform specific suspend */
-	ret = hsm_device_hart_suspend(suspend_type);
+	ret = hsm_device_hart_suspend(enter_type);
 	if (ret == SBI_ENOTSUPP) {
 		/* Try generic implementation of default suspend types */
-		if (suspend_type == SBI_HSM_SUSPEND_RET_DEFAULT ||
-		    suspend_type == SBI_HSM_SUSPEND_NON_RET_DEFAULT) {
+		if (enter_type == SBI_HSM_SUSPEND_RET_DEFAULT ||
+		    enter_type == SBI_HSM_SUSPEND_NON_RET_DEFAULT) {
 			ret = __sbi_hsm_suspend_default(scratch);
 		}
 	}
 
+	sbi_hsm_idle_exit(scratch);
+	sbi_heap_hart_online();
+
 	/*
 	 * The platform may have coordinated a retentive suspend, or it may
 	 * have exited early from a non-retentive suspend. Either way, the
@@ -536,6 +576,9 @@ int sbi_hsm_hart_suspend(struct sbi_scratch *scratch, u32 suspend_type,
 		void (*jump_warmboot)(void) =
 			(void (*)(void))scratch->warmboot_addr;
 
+		/* Platform has nothing to restore after a retentive suspend */
+		hdata->skip_device_resume =
+			!(enter_type & SBI_HSM_SUSP_NON_RET_BIT);
 		jump_warmboot();
 	}
 
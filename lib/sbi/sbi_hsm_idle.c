@@ -0,0 +1,269 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_idle.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_timer.h>
+
+/** Per-hart idle governor state */
+struct sbi_hsm_idle_hart {
+	/** Index of the state being entered (-1 when not suspended) */
+	int cur;
+	/** Timer value sampled when entering the current state */
+	u64 entry_time;
+	/** Statistics of each state plus the default retentive state */
+	u64 stats[][SBI_HSM_IDLE_STAT_MAX];
+};
+
+static const struct sbi_cpu_idle_state *idle_states;
+static u32 idle_state_count;
+
+/** Index of the default retentive suspend when it is not in the table */
+#define idle_default_index()	idle_state_count
+
+#ifdef CONFIG_SBI_HSM_IDLE_GOVERNOR_PROMOTE
+#define idle_allow_promote	true
+#else
+#define idle_allow_promote	false
+#endif
+
+/** Offset of pointer to idle governor HART state in scratch space */
+static unsigned long idle_ptr_offset;
+
+#define idle_get_hart_ptr(__scratch)					\
+	idle_ptr_offset ?						\
+	sbi_scratch_read_type((__scratch), struct sbi_hsm_idle_hart *,	\
+			      idle_ptr_offset) : NULL
+
+static u64 idle_ticks_to_us(u64 ticks)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+
+	if (!tdev || !tdev->timer_freq)
+		return 0;
+
+	return (ticks * 1000000ULL) / tdev->timer_freq;
+}
+
+/* Predict time until the next wakeup from the pending timer event */
+static u64 idle_predict_us(void)
+{
+	u64 now = sbi_timer_value();
+	u64 next = sbi_timer_next_event();
+
+	if (next == -1ULL)
+		return -1ULL;
+	if (next <= now)
+		return 0;
+
+	/* Avoid overflow in the conversion for far away events */
+	if ((next - now) > (-1ULL / 1000000ULL))
+		return -1ULL;
+
+	return idle_ticks_to_us(next - now);
+}
+
+static int idle_find_state(u32 suspend_type)
+{
+	u32 i;
+
+	for (i = 0; i < idle_state_count; i++) {
+		if (idle_states[i].suspend_param == suspend_type)
+			return i;
+	}
+
+	return -1;
+}
+
+static u64 idle_state_depth(int index)
+{
+	return ((u32)index < idle_state_count) ?
+		idle_states[index].min_residency_us : 0;
+}
+
+u32 sbi_hsm_idle_select(struct sbi_scratch *scratch, u32 suspend_type)
+{
+	struct sbi_hsm_idle_hart *ihart = idle_get_hart_ptr(scratch);
+	const struct sbi_cpu_idle_state *st;
+	u64 predicted, limit;
+	int req, best = -1;
+	u32 i;
+
+	if (!ihart)
+		return suspend_type;
+
+	req = idle_find_state(suspend_type);
+	if (req < 0) {
+		/* Platform types unknown to the governor pass through */
+		if (suspend_type != SBI_HSM_SUSPEND_RET_DEFAULT) {
+			ihart->cur = -1;
+			return suspend_type;
+		}
+		req = idle_default_index();
+	}
+
+	predicted = idle_predict_us();
+	limit = idle_state_depth(req);
+
+	for (i = 0; i < idle_state_count; i++) {
+		st = &idle_states[i];
+
+		/* Never lose context the supervisor expects to be retained */
+		if ((st->suspend_param & SBI_HSM_SUSP_NON_RET_BIT) &&
+		    !(suspend_type & SBI_HSM_SUSP_NON_RET_BIT))
+			continue;
+		if (!idle_allow_promote &&
+		    st->min_residency_us > limit)
+			continue;
+		if (st->min_residency_us > predicted ||
+		    (u64)st->entry_latency_us + st->exit_latency_us > predicted)
+			continue;
+		if (best < 0 ||
+		    st->min_residency_us > idle_states[best].min_residency_us)
+			best = i;
+	}
+
+	/* Nothing fits, fall back to the shallowest retentive suspend */
+	if (best < 0) {
+		best = idle_find_state(SBI_HSM_SUSPEND_RET_DEFAULT);
+		if (best < 0)
+			best = idle_default_index();
+	}
+
+	ihart->stats[best][SBI_HSM_IDLE_STAT_USAGE]++;
+	if (idle_state_depth(best) < limit)
+		ihart->stats[best][SBI_HSM_IDLE_STAT_DEMOTED]++;
+	else if (idle_state_depth(best) > limit)
+		ihart->stats[best][SBI_HSM_IDLE_STAT_PROMOTED]++;
+
+	ihart->cur = best;
+	ihart->entry_time = sbi_timer_value();
+
+	return ((u32)best < idle_state_count) ?
+		idle_states[best].suspend_param : SBI_HSM_SUSPEND_RET_DEFAULT;
+}
+
+void sbi_hsm_idle_exit(struct sbi_scratch *scratch)
+{
+	struct sbi_hsm_idle_hart *ihart = idle_get_hart_ptr(scratch);
+	u64 residency;
+
+	if (!ihart || ihart->cur < 0)
+		return;
+
+	residency = idle_ticks_to_us(sbi_timer_value() - ihart->entry_time);
+	ihart->stats[ihart->cur][SBI_HSM_IDLE_STAT_RESIDENCY_US] += residency;
+	if (residency >= idle_state_depth(ihart->cur))
+		ihart->stats[ihart->cur][SBI_HSM_IDLE_STAT_HITS]++;
+	else
+		ihart->stats[ihart->cur][SBI_HSM_IDLE_STAT_MISSES]++;
+
+	ihart->cur = -1;
+}
+
+int sbi_hsm_idle_get_stat(u32 hartid, u32 state, u32 stat, u64 *out_val)
+{
+	struct sbi_scratch *scratch = sbi_hartid_to_scratch(hartid);
+	struct sbi_hsm_idle_hart *ihart;
+
+	if (!scratch || !out_val)
+		return SBI_EINVAL;
+
+	ihart = idle_get_hart_ptr(scratch);
+	if (!ihart)
+		return SBI_ENOTSUPP;
+	if (state > idle_default_index() || stat >= SBI_HSM_IDLE_STAT_MAX)
+		return SBI_EINVAL;
+
+	*out_val = ihart->stats[state][stat];
+	return 0;
+}
+
+const struct sbi_cpu_idle_state *sbi_hsm_idle_get_states(void)
+{
+	return idle_states;
+}
+
+int sbi_hsm_idle_set_states(const struct sbi_cpu_idle_state *states)
+{
+	struct sbi_hsm_idle_hart *ihart;
+	struct sbi_scratch *rscratch;
+	u32 i, count = 0;
+
+	if (!states || idle_states)
+		return 0;
+
+	while (states[count].name)
+		count++;
+	if (!count)
+		return 0;
+
+	idle_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+	if (!idle_ptr_offset)
+		return SBI_ENOMEM;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+
+		ihart = sbi_zalloc(sizeof(*ihart) +
+				   (count + 1) * sizeof(ihart->stats[0]));
+		if (!ihart)
+			return SBI_ENOMEM;
+		ihart->cur = -1;
+		sbi_scratch_write_type(rscratch, void *, idle_ptr_offset, ihart);
+	}
+
+	idle_state_count = count;
+	idle_states = states;
+
+	return 0;
+}
+
+static int hsm_idle_test_hart_suspend(u32 suspend_type)
+{
+	/* Every state is a plain WFI, non-retentive ones exit early */
+	wfi();
+
+	return 0;
+}
+
+static const struct sbi_hsm_device hsm_idle_test = {
+	.name = "hsm-idle-test",
+	.hart_suspend = hsm_idle_test_hart_suspend,
+};
+
+static const struct sbi_cpu_idle_state hsm_idle_test_states[] = {
+	{
+		.name = "test-ret",
+		.suspend_param = SBI_HSM_SUSPEND_RET_PLATFORM,
+		.entry_latency_us = 10,
+		.exit_latency_us = 10,
+		.min_residency_us = 100,
+		.wakeup_latency_us = 20,
+	},
+	{
+		.name = "test-non-ret",
+		.suspend_param = SBI_HSM_SUSPEND_NON_RET_DEFAULT,
+		.entry_latency_us = 100,
+		.exit_latency_us = 100,
+		.min_residency_us = 1000,
+		.wakeup_latency_us = 200,
+	},
+	{ }
+};
+
+void sbi_hsm_idle_test_enable(void)
+{
+	sbi_hsm_set_device(&hsm_idle_test);
+	sbi_hsm_idle_set_states(hsm_idle_test_states);
+}
@@ -29,7 +29,9 @@
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_timer.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
 #include <sbi/sbi_version.h>
+#include <sbi/sbi_wait.h>
 
 #define BANNER                                              \
 	"   ____                    _____ ____ _____\n"     \
@@ -76,6 +78,7 @@ static void sbi_boot_print_general(struct sbi_scratch *scratch)
 	const struct sbi_system_suspend_device *susp_dev;
 	const struct sbi_cppc_device *cppc_dev;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
+	unsigned long peak, largest, blocks, failed;
 
 	if (scratch->options & SBI_SCRATCH_NO_BOOT_PRINTS)
 		return;
@@ -130,11 +133,22 @@ static void sbi_boot_print_general(struct sbi_scratch *scratch)
 		   (u32)(sbi_heap_reserved_space() / 1024),
 		   (u32)(sbi_heap_used_space() / 1024),
 		   (u32)(sbi_heap_free_space() / 1024));
+	sbi_heap_get_stat(SBI_HEAP_STAT_PEAK, &peak);
+	sbi_heap_get_stat(SBI_HEAP_STAT_LARGEST_FREE, &largest);
+	sbi_heap_get_stat(SBI_HEAP_STAT_FREE_BLOCKS, &blocks);
+	sbi_heap_get_stat(SBI_HEAP_STAT_FAILED_ALLOCS, &failed);
+	sbi_printf("Firmware Heap Usage       : "
+		   "%d KB (peak), %d KB (largest free), %d (free blocks), "
+		   "%d (failed)\n", (u32)(peak / 1024), (u32)(largest / 1024),
+		   (u32)blocks, (u32)failed);
+	sbi_heap_dump_callers();
 	sbi_printf("Firmware Scratch Size     : "
 		   "%d B (total), %d B (used), %d B (free)\n",
 		   SBI_SCRATCH_SIZE,
 		   (u32)sbi_scratch_used_space(),
 		   (u32)(SBI_SCRATCH_SIZE - sbi_scratch_used_space()));
+	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS)
+		sbi_scratch_dump_layout();
 
 	/* SBI details */
 	sbi_printf("Runtime SBI Version       : %d.%d\n",
@@ -190,14 +204,14 @@ static void sbi_boot_print_hart(struct sbi_scratch *scratch, u32 hartid)
 	sbi_hart_delegation_dump(scratch, "Boot HART ", "         ");
 }
 
-static spinlock_t coldboot_lock = SPIN_LOCK_INITIALIZER;
+static qspinlock_t coldboot_lock = QSPIN_LOCK_INITIALIZER;
 static struct sbi_hartmask coldboot_wait_hmask = { 0 };
 
 static unsigned long coldboot_done;
 
 static void wait_for_coldboot(struct sbi_scratch *scratch, u32 hartid)
 {
-	unsigned long saved_mie, cmip;
+	unsigned long saved_mie;
 
 	if (__smp_load_acquire(&coldboot_done))
 		return;
@@ -209,30 +223,25 @@ static void wait_for_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	csr_set(CSR_MIE, MIP_MSIP | MIP_MEIP);
 
 	/* Acquire coldboot lock */
-	spin_lock(&coldboot_lock);
+	qspin_lock(&coldboot_lock);
 
 	/* Mark current HART as waiting */
 	sbi_hartmask_set_hartid(hartid, &coldboot_wait_hmask);
 
 	/* Release coldboot lock */
-	spin_unlock(&coldboot_lock);
-
-	/* Wait for coldboot to finish using WFI */
-	while (!__smp_load_acquire(&coldboot_done)) {
-		do {
-			wfi();
-			cmip = csr_read(CSR_MIP);
-		 } while (!(cmip & (MIP_MSIP | MIP_MEIP)));
-	}
+	qspin_unlock(&coldboot_lock);
+
+	/* Wait for coldboot to finish using WRS.NTO or WFI */
+	sbi_wait_on_idle(&coldboot_done, VAL);
 
 	/* Acquire coldboot lock */
-	spin_lock(&coldboot_lock);
+	qspin_lock(&coldboot_lock);
 
 	/* Unmark current HART as waiting */
 	sbi_hartmask_clear_hartid(hartid, &coldboot_wait_hmask);
 
 	/* Release coldboot lock */
-	spin_unlock(&coldboot_lock);
+	qspin_unlock(&coldboot_lock);
 
 	/* Restore MIE CSR */
 	csr_write(CSR_MIE, saved_mie);
@@ -255,7 +264,7 @@ static void wake_coldboot_harts(struct sbi_scratch *scratch, u32 hartid)
 	__smp_store_release(&coldboot_done, 1);
 
 	/* Acquire coldboot lock */
-	spin_lock(&coldboot_lock);
+	qspin_lock(&coldboot_lock);
 
 	/* Send an IPI to all HARTs waiting for coldboot */
 	sbi_hartmask_for_each_hartindex(i, &coldboot_wait_hmask) {
@@ -265,7 +274,7 @@ static void wake_coldboot_harts(struct sbi_scratch *scratch, u32 hartid)
 	}
 
 	/* Release coldboot lock */
-	spin_unlock(&coldboot_lock);
+	qspin_unlock(&coldboot_lock);
 }
 
 static unsigned long entry_count_offset;
@@ -287,6 +296,8 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	if (rc)
 		sbi_hart_hang();
 
+	qspin_lock_stats_register(&coldboot_lock, "coldboot");
+
 	/* Note: This has to be the third thing in coldboot init sequence */
 	rc = sbi_domain_init(scratch, hartid);
 	if (rc)
@@ -357,6 +368,12 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 		sbi_hart_hang();
 	}
 
+	rc = sbi_trace_init(scratch, true);
+	if (rc) {
+		sbi_printf("%s: trace init failed (error %d)\n", __func__, rc);
+		sbi_hart_hang();
+	}
+
 
 	/*
 	 * Note: Finalize domains after HSM initialization so that we
@@ -427,6 +444,9 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	count = sbi_scratch_offset_ptr(scratch, init_count_offset);
 	(*count)++;
 
+	/* Boot messages are written, buffer runtime messages from now on */
+	sbi_console_buffer_enable();
+
 	sbi_hsm_hart_start_finish(scratch, hartid);
 }
 
@@ -479,6 +499,10 @@ static void __noreturn init_warm_startup(struct sbi_scratch *scratch,
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_trace_init(scratch, false);
+	if (rc)
+		sbi_hart_hang();
+
 	rc = sbi_platform_final_init(plat, false);
 	if (rc)
 		sbi_hart_hang();
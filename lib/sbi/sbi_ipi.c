@@ -22,6 +22,8 @@
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
+#include <sbi/sbi_wait.h>
 
 struct sbi_ipi_data {
 	unsigned long ipi_type;
@@ -78,6 +80,9 @@ static int sbi_ipi_send(struct sbi_scratch *scratch, u32 remote_hartindex,
 	 * remote hart so call sbi_ipi_raw_send() only when
 	 * the ipi_type was previously zero.
 	 */
+	sbi_trace(SBI_TRACE_IPI_SEND, sbi_hartindex_to_hartid(remote_hartindex),
+		  event, 0, 0);
+
 	if (!__atomic_fetch_or(&ipi_data->ipi_type,
 				BIT(event), __ATOMIC_RELAXED))
 		ret = sbi_ipi_raw_send(remote_hartindex);
@@ -115,6 +120,7 @@ int sbi_ipi_send_many(ulong hmask, ulong hbase, u32 event, void *data)
 	struct sbi_hartmask target_mask = {0};
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	struct sbi_wait_state ws = SBI_WAIT_STATE_INIT(false);
 
 	/* Find the target harts */
 	if (hbase != -1UL) {
@@ -151,6 +157,9 @@ int sbi_ipi_send_many(ulong hmask, ulong hbase, u32 event, void *data)
 				sbi_hartmask_clear_hartindex(i, &target_mask);
 			rc = 0;
 		}
+		/* Back off before retrying harts with a busy IPI update */
+		if (retry_needed)
+			sbi_wait_relax(&ws, NULL, 0, 0);
 	} while (retry_needed);
 
 done:
@@ -239,6 +248,7 @@ void sbi_ipi_process(void)
 	sbi_ipi_raw_clear(hartindex);
 
 	ipi_type = atomic_raw_xchg_ulong(&ipi_data->ipi_type, 0);
+	sbi_trace(SBI_TRACE_IPI_PROCESS, ipi_type, 0, 0, 0);
 	ipi_event = 0;
 	while (ipi_type) {
 		if (ipi_type & 1UL) {
@@ -307,7 +317,8 @@ int sbi_ipi_init(struct sbi_scratch *scratch, bool cold_boot)
 	struct sbi_ipi_data *ipi_data;
 
 	if (cold_boot) {
-		ipi_data_off = sbi_scratch_alloc_offset(sizeof(*ipi_data));
+		ipi_data_off = sbi_scratch_alloc_offset_flags(sizeof(*ipi_data),
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
 		if (!ipi_data_off)
 			return SBI_ENOMEM;
 		ret = sbi_ipi_event_create(&ipi_smode_ops);
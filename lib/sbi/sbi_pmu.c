@@ -10,6 +10,7 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
@@ -17,6 +18,7 @@
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 
 /** Information about hardware counters */
 struct sbi_pmu_hw_event {
@@ -54,22 +56,77 @@ union sbi_pmu_ctr_info {
 #error "Can't handle firmware counters beyond BITS_PER_LONG"
 #endif
 
+#if SBI_PMU_MUX_CTR_MAX >= BITS_PER_LONG
+#error "Can't handle multiplexed counters beyond BITS_PER_LONG"
+#endif
+
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+/** State of a multiplexed counter */
+struct sbi_pmu_mux_ctr {
+	/* Configuration flags of the event */
+	unsigned long flags;
+	/* Event data of the event */
+	uint64_t data;
+	/* Hardware counter the event is scheduled on (-1 if none) */
+	int hw_cidx;
+	/* Counter value accumulated while scheduled out */
+	uint64_t value;
+	/* Timer values when the counter was started and scheduled in */
+	uint64_t enabled_stamp;
+	uint64_t running_stamp;
+	/* Time the counter was started and scheduled on hardware */
+	uint64_t enabled_time;
+	uint64_t running_time;
+};
+#endif
+
 /** Per-HART state of the PMU counters */
 struct sbi_pmu_hart_state {
 	/* HART to which this state belongs */
 	uint32_t hartid;
 	/* Counter to enabled event mapping */
-	uint32_t active_events[SBI_PMU_HW_CTR_MAX + SBI_PMU_FW_CTR_MAX];
+	uint32_t active_events[SBI_PMU_CTR_MAX];
 	/* Bitmap of firmware counters started */
 	unsigned long fw_counters_started;
+	/* Bitmap of started firmware counters for each SBI firmware event */
+	unsigned long fw_event_counters[SBI_PMU_FW_MAX];
+	/* Bitmap of firmware counters overflown since they were started */
+	unsigned long fw_counters_overflown;
 	/*
 	 * Counter values for SBI firmware events and event codes
 	 * for platform firmware events. Both are mutually exclusive
 	 * and hence can optimally share the same memory.
 	 */
 	uint64_t fw_counters_data[SBI_PMU_FW_CTR_MAX];
+	/* Counter snapshot shared memory is set */
+	bool snapshot_valid;
+	/* Counter snapshot shared memory */
+	struct sbi_pmu_snapshot *snapshot;
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+	/* Bitmap of multiplexed counters started */
+	unsigned long mux_counters_started;
+	/* Bitmap of multiplexed counters scheduled on hardware counters */
+	unsigned long mux_counters_scheduled;
+	/* Multiplexed counter to schedule first on the next rotation */
+	uint32_t mux_next;
+	struct sbi_pmu_mux_ctr mux_ctrs[SBI_PMU_MUX_CTR_MAX];
+#endif
 };
 
+static inline void pmu_fw_event_map_set(struct sbi_pmu_hart_state *phs,
+					uint32_t event_code, uint32_t fw_cidx)
+{
+	if (event_code < SBI_PMU_FW_MAX)
+		phs->fw_event_counters[event_code] |= BIT(fw_cidx);
+}
+
+static inline void pmu_fw_event_map_clear(struct sbi_pmu_hart_state *phs,
+					  uint32_t event_code, uint32_t fw_cidx)
+{
+	if (event_code < SBI_PMU_FW_MAX)
+		phs->fw_event_counters[event_code] &= ~BIT(fw_cidx);
+}
+
 /** Offset of pointer to PMU HART state in scratch space */
 static unsigned long phs_ptr_offset;
 
@@ -93,14 +150,39 @@ static uint32_t num_hw_events;
 /* Maximum number of hardware counters available */
 static uint32_t num_hw_ctrs;
 
+/* Number of multiplexed counters available */
+static uint32_t num_mux_ctrs;
+
 /* Maximum number of counters available */
 static uint32_t total_ctrs;
 
+/* Mask of the value of SBI firmware counters */
+static uint64_t fw_ctr_mask = ~0ULL;
+
 /* Helper macros to retrieve event idx and code type */
 #define get_cidx_type(x) \
   (((x) & SBI_PMU_EVENT_IDX_TYPE_MASK) >> SBI_PMU_EVENT_IDX_TYPE_OFFSET)
 #define get_cidx_code(x) (x & SBI_PMU_EVENT_IDX_CODE_MASK)
 
+/*
+ * Multiplexed counters follow the firmware counters. Supervisor reads
+ * them through the unimplemented hpmcounter CSRs following the hardware
+ * counters, which trap and get emulated.
+ */
+#define pmu_mux_idx(__cidx)	((__cidx) - num_hw_ctrs - SBI_PMU_FW_CTR_MAX)
+#define pmu_mux_csr_idx(__midx)	(num_hw_ctrs + (__midx))
+
+static inline bool pmu_ctr_is_mux(uint32_t cidx)
+{
+	return (num_hw_ctrs + SBI_PMU_FW_CTR_MAX) <= cidx && cidx < total_ctrs;
+}
+
+static uint64_t pmu_mux_ctr_read(struct sbi_pmu_hart_state *phs,
+				 uint32_t cidx);
+static int pmu_mux_ctr_start(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			     uint64_t ival, bool ival_update);
+static int pmu_mux_ctr_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx);
+
 /**
  * Perform a sanity check on event & counter mappings with event range overlap check
  * @param evtA Pointer to the existing hw event structure
@@ -201,6 +283,20 @@ static int pmu_ctr_validate(struct sbi_pmu_hart_state *phs,
 	return event_idx_type;
 }
 
+static uint64_t pmu_ctr_read_fw(struct sbi_pmu_hart_state *phs,
+				uint32_t cidx, uint32_t event_code)
+{
+	if (SBI_PMU_FW_PLATFORM == event_code) {
+		if (pmu_dev && pmu_dev->fw_counter_read_value)
+			return pmu_dev->fw_counter_read_value(phs->hartid,
+							      cidx -
+							      num_hw_ctrs);
+		return 0;
+	}
+
+	return phs->fw_counters_data[cidx - num_hw_ctrs];
+}
+
 int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 {
 	int event_idx_type;
@@ -219,15 +315,7 @@ int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 	    event_code > SBI_PMU_FW_PLATFORM)
 		return SBI_EINVAL;
 
-	if (SBI_PMU_FW_PLATFORM == event_code) {
-		if (pmu_dev && pmu_dev->fw_counter_read_value)
-			*cval = pmu_dev->fw_counter_read_value(phs->hartid,
-							       cidx -
-							       num_hw_ctrs);
-		else
-			*cval = 0;
-	} else
-		*cval = phs->fw_counters_data[cidx - num_hw_ctrs];
+	*cval = pmu_ctr_read_fw(phs, cidx, event_code);
 
 	return 0;
 }
@@ -347,6 +435,36 @@ static void pmu_ctr_write_hw(uint32_t cidx, uint64_t ival)
 #endif
 }
 
+static uint64_t pmu_ctr_read_hw(uint32_t cidx)
+{
+#if __riscv_xlen == 32
+	uint32_t hi, lo;
+
+	do {
+		hi = csr_read_num(CSR_MCYCLEH + cidx);
+		lo = csr_read_num(CSR_MCYCLE + cidx);
+	} while (hi != csr_read_num(CSR_MCYCLEH + cidx));
+
+	return ((uint64_t)hi << 32) | lo;
+#else
+	return csr_read_num(CSR_MCYCLE + cidx);
+#endif
+}
+
+static bool pmu_ctr_overflown_hw(uint32_t cidx)
+{
+	if (cidx < 3 || cidx >= SBI_PMU_HW_CTR_MAX ||
+	    !sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+				    SBI_HART_EXT_SSCOFPMF))
+		return false;
+
+#if __riscv_xlen == 32
+	return csr_read_num(CSR_MHPMEVENT3H + cidx - 3) & MHPMEVENTH_OF;
+#else
+	return csr_read_num(CSR_MHPMEVENT3 + cidx - 3) & MHPMEVENT_OF;
+#endif
+}
+
 static int pmu_ctr_start_hw(uint32_t cidx, uint64_t ival, bool ival_update)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
@@ -423,10 +541,14 @@ static int pmu_ctr_start_fw(struct sbi_pmu_hart_state *phs,
 						 event_data);
 	} else {
 		if (ival_update)
-			phs->fw_counters_data[cidx - num_hw_ctrs] = ival;
+			phs->fw_counters_data[cidx - num_hw_ctrs] =
+							ival & fw_ctr_mask;
 	}
 
+	/* Re-arm the overflow interrupt */
+	phs->fw_counters_overflown &= ~BIT(cidx - num_hw_ctrs);
 	phs->fw_counters_started |= BIT(cidx - num_hw_ctrs);
+	pmu_fw_event_map_set(phs, event_code, cidx - num_hw_ctrs);
 
 	return 0;
 }
@@ -445,12 +567,17 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 	bool bUpdate = false;
 	int i, cidx;
 	uint64_t edata;
+	struct sbi_pmu_snapshot *sdata = NULL;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return ret;
 
-	if (flags & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
+	if (flags & SBI_PMU_START_FLAG_INIT_FROM_SNAPSHOT) {
+		if (!phs->snapshot_valid)
+			return SBI_ENO_SHMEM;
+		sdata = phs->snapshot;
+		bUpdate = true;
+	}
 
 	if (flags & SBI_PMU_START_FLAG_SET_INIT_VALUE)
 		bUpdate = true;
@@ -461,13 +588,24 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 		if (event_idx_type < 0)
 			/* Continue the start operation for other counters */
 			continue;
-		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
+
+		/* Initial values are taken from the snapshot */
+		if (sdata) {
+			sbi_hart_map_saddr((unsigned long)sdata,
+					   SBI_PMU_SNAPSHOT_SIZE);
+			ival = sdata->ctr_values[i];
+			sbi_hart_unmap_saddr();
+		}
+
+		if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
 			edata = (event_code == SBI_PMU_FW_PLATFORM) ?
 				 phs->fw_counters_data[cidx - num_hw_ctrs]
 				 : 0x0;
 			ret = pmu_ctr_start_fw(phs, cidx, event_code, edata,
 					       ival, bUpdate);
 		}
+		else if (pmu_ctr_is_mux(cidx))
+			ret = pmu_mux_ctr_start(phs, cidx, ival, bUpdate);
 		else
 			ret = pmu_ctr_start_hw(cidx, ival, bUpdate);
 	}
@@ -518,6 +656,7 @@ static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 	}
 
 	phs->fw_counters_started &= ~BIT(cidx - num_hw_ctrs);
+	pmu_fw_event_map_clear(phs, event_code, cidx - num_hw_ctrs);
 
 	return 0;
 }
@@ -538,6 +677,30 @@ static int pmu_reset_hw_mhpmevent(int ctr_idx)
 	return 0;
 }
 
+static void pmu_ctr_snapshot_save(struct sbi_pmu_hart_state *phs,
+				  struct sbi_pmu_snapshot *sdata,
+				  uint32_t idx, uint32_t cidx,
+				  int event_idx_type, uint32_t event_code)
+{
+	bool overflown = false;
+
+	if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
+		sdata->ctr_values[idx] = pmu_ctr_read_fw(phs, cidx, event_code);
+		overflown = phs->fw_counters_overflown &
+			    BIT(cidx - num_hw_ctrs);
+	} else if (pmu_ctr_is_mux(cidx)) {
+		sdata->ctr_values[idx] = pmu_mux_ctr_read(phs, cidx);
+	} else {
+		sdata->ctr_values[idx] = pmu_ctr_read_hw(cidx);
+		overflown = pmu_ctr_overflown_hw(cidx);
+	}
+
+	if (overflown)
+		sdata->ctr_overflow_mask |= (1ULL << idx);
+	else
+		sdata->ctr_overflow_mask &= ~(1ULL << idx);
+}
+
 int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 		     unsigned long flag)
 {
@@ -550,12 +713,16 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 	int event_idx_type;
 	uint32_t event_code;
 	int i, cidx;
+	struct sbi_pmu_snapshot *sdata = NULL;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return SBI_EINVAL;
 
-	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
+	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT) {
+		if (!phs->snapshot_valid)
+			return SBI_ENO_SHMEM;
+		sdata = phs->snapshot;
+	}
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
 		cidx = i + cbase;
@@ -566,12 +733,23 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 
 		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW)
 			ret = pmu_ctr_stop_fw(phs, cidx, event_code);
+		else if (pmu_ctr_is_mux(cidx))
+			ret = pmu_mux_ctr_stop(phs, cidx);
 		else
 			ret = pmu_ctr_stop_hw(cidx);
 
+		if (sdata) {
+			sbi_hart_map_saddr((unsigned long)sdata,
+					   SBI_PMU_SNAPSHOT_SIZE);
+			pmu_ctr_snapshot_save(phs, sdata, i, cidx,
+					      event_idx_type, event_code);
+			sbi_hart_unmap_saddr();
+		}
+
 		if (cidx > (CSR_INSTRET - CSR_CYCLE) && flag & SBI_PMU_STOP_FLAG_RESET) {
 			phs->active_events[cidx] = SBI_PMU_EVENT_IDX_INVALID;
-			pmu_reset_hw_mhpmevent(cidx);
+			if (!pmu_ctr_is_mux(cidx))
+				pmu_reset_hw_mhpmevent(cidx);
 		}
 	}
 
@@ -782,7 +960,8 @@ static int pmu_ctr_find_fw(struct sbi_pmu_hart_state *phs,
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
 		cidx = i + cbase;
-		if (cidx < num_hw_ctrs || total_ctrs <= cidx)
+		if (cidx < num_hw_ctrs || pmu_ctr_is_mux(cidx) ||
+		    total_ctrs <= cidx)
 			continue;
 		if (phs->active_events[i] != SBI_PMU_EVENT_IDX_INVALID)
 			continue;
@@ -800,6 +979,350 @@ static int pmu_ctr_find_fw(struct sbi_pmu_hart_state *phs,
 	return SBI_ENOTSUPP;
 }
 
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+/* Rate of rotation of waiting multiplexed counters */
+#define PMU_MUX_ROTATE_HZ	250
+
+/**
+ * Only events mapped to programmable counters are multiplexed because
+ * the fixed counters are shared by all users.
+ */
+static bool pmu_mux_event_supported(unsigned long event_idx, uint64_t data)
+{
+	struct sbi_pmu_hw_event *temp;
+	int i;
+
+	if (pmu_ctr_find_fixed_hw(event_idx) >= 0)
+		return false;
+
+	for (i = 0; i < num_hw_events; i++) {
+		temp = &hw_event_map[i];
+		if ((temp->start_idx > event_idx && event_idx < temp->end_idx) ||
+		    (temp->start_idx < event_idx && event_idx > temp->end_idx))
+			continue;
+		if (event_idx == SBI_PMU_EVENT_RAW_IDX &&
+		    temp->select != (data & temp->select_mask))
+			continue;
+		if (temp->counters & ~SBI_PMU_FIXED_CTR_MASK)
+			return true;
+	}
+
+	return false;
+}
+
+static bool pmu_mux_sched_in(struct sbi_pmu_hart_state *phs, uint32_t midx,
+			     uint64_t now)
+{
+	struct sbi_pmu_mux_ctr *mctr = &phs->mux_ctrs[midx];
+	uint32_t event_idx =
+		phs->active_events[num_hw_ctrs + SBI_PMU_FW_CTR_MAX + midx];
+	int hw_cidx;
+
+	hw_cidx = pmu_ctr_find_hw(phs, 0, -1UL, mctr->flags, event_idx,
+				  mctr->data);
+	if (hw_cidx < 0)
+		return false;
+
+	phs->active_events[hw_cidx] = event_idx;
+	mctr->hw_cidx = hw_cidx;
+	mctr->running_stamp = now;
+	phs->mux_counters_scheduled |= BIT(midx);
+
+	/*
+	 * Count from zero and keep the overflow interrupt disabled since
+	 * supervisor does not know about this hardware counter.
+	 */
+	pmu_ctr_write_hw(hw_cidx, 0);
+	if (sbi_hart_priv_version(sbi_scratch_thishart_ptr()) >=
+	    SBI_HART_PRIV_VER_1_11)
+		csr_clear(CSR_MCOUNTINHIBIT, BIT(hw_cidx));
+
+	return true;
+}
+
+static void pmu_mux_sched_out(struct sbi_pmu_hart_state *phs, uint32_t midx,
+			      uint64_t now)
+{
+	struct sbi_pmu_mux_ctr *mctr = &phs->mux_ctrs[midx];
+
+	if (mctr->hw_cidx < 0)
+		return;
+
+	if (sbi_hart_priv_version(sbi_scratch_thishart_ptr()) >=
+	    SBI_HART_PRIV_VER_1_11)
+		csr_set(CSR_MCOUNTINHIBIT, BIT(mctr->hw_cidx));
+	mctr->value += pmu_ctr_read_hw(mctr->hw_cidx);
+	mctr->running_time += now - mctr->running_stamp;
+
+	phs->active_events[mctr->hw_cidx] = SBI_PMU_EVENT_IDX_INVALID;
+	phs->mux_counters_scheduled &= ~BIT(midx);
+	mctr->hw_cidx = -1;
+}
+
+/**
+ * Rotate again later while counters are waiting. Without Sstc, supervisor
+ * timer events go through M-mode and rotate on the way, otherwise use the
+ * M-mode timer which supervisor does not use.
+ */
+static void pmu_mux_rotation_start(struct sbi_pmu_hart_state *phs,
+				   uint64_t now)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+
+	if (phs->mux_counters_started == phs->mux_counters_scheduled ||
+	    !tdev || !tdev->timer_freq)
+		return;
+
+	sbi_timer_mmode_event_start(now + tdev->timer_freq /
+				    PMU_MUX_ROTATE_HZ);
+}
+
+/**
+ * Schedule waiting counters on free hardware counters in round-robin
+ * order. The first counter left waiting goes first on the next rotation.
+ */
+static void pmu_mux_schedule(struct sbi_pmu_hart_state *phs, uint64_t now)
+{
+	unsigned long waiting = phs->mux_counters_started &
+				~phs->mux_counters_scheduled;
+	int i, j, first_waiting = -1;
+
+	for (j = 0; j < SBI_PMU_MUX_CTR_MAX; j++) {
+		i = (phs->mux_next + j) % SBI_PMU_MUX_CTR_MAX;
+		if (!(waiting & BIT(i)))
+			continue;
+		if (!pmu_mux_sched_in(phs, i, now) && first_waiting < 0)
+			first_waiting = i;
+	}
+
+	if (first_waiting >= 0)
+		phs->mux_next = first_waiting;
+
+	pmu_mux_rotation_start(phs, now);
+}
+
+void sbi_pmu_mux_rotate(void)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+	unsigned long scheduled;
+	uint64_t now;
+	int i;
+
+	/* Nothing to rotate unless a started counter is waiting */
+	if (!phs || phs->mux_counters_started == phs->mux_counters_scheduled)
+		return;
+
+	now = sbi_timer_value();
+	scheduled = phs->mux_counters_scheduled;
+	for_each_set_bit(i, &scheduled, SBI_PMU_MUX_CTR_MAX)
+		pmu_mux_sched_out(phs, i, now);
+	pmu_mux_schedule(phs, now);
+}
+
+static uint64_t pmu_mux_ctr_read(struct sbi_pmu_hart_state *phs,
+				 uint32_t cidx)
+{
+	struct sbi_pmu_mux_ctr *mctr = &phs->mux_ctrs[pmu_mux_idx(cidx)];
+
+	if (mctr->hw_cidx < 0)
+		return mctr->value;
+
+	return mctr->value + pmu_ctr_read_hw(mctr->hw_cidx);
+}
+
+static void pmu_mux_ctr_write(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			      uint64_t ival)
+{
+	struct sbi_pmu_mux_ctr *mctr = &phs->mux_ctrs[pmu_mux_idx(cidx)];
+
+	if (mctr->hw_cidx >= 0)
+		pmu_ctr_write_hw(mctr->hw_cidx, 0);
+	mctr->value = ival;
+}
+
+static int pmu_mux_ctr_start(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			     uint64_t ival, bool ival_update)
+{
+	uint32_t midx = pmu_mux_idx(cidx);
+	uint64_t now;
+
+	if (phs->mux_counters_started & BIT(midx))
+		return SBI_EALREADY_STARTED;
+
+	if (ival_update)
+		pmu_mux_ctr_write(phs, cidx, ival);
+
+	now = sbi_timer_value();
+	phs->mux_ctrs[midx].enabled_stamp = now;
+	phs->mux_counters_started |= BIT(midx);
+
+	/* Use a free hardware counter right away, if any */
+	if (!pmu_mux_sched_in(phs, midx, now))
+		pmu_mux_rotation_start(phs, now);
+
+	return 0;
+}
+
+static int pmu_mux_ctr_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	struct sbi_pmu_mux_ctr *mctr = &phs->mux_ctrs[pmu_mux_idx(cidx)];
+	uint32_t midx = pmu_mux_idx(cidx);
+	uint64_t now;
+
+	if (!(phs->mux_counters_started & BIT(midx)))
+		return SBI_EALREADY_STOPPED;
+
+	now = sbi_timer_value();
+	pmu_mux_sched_out(phs, midx, now);
+	mctr->enabled_time += now - mctr->enabled_stamp;
+	phs->mux_counters_started &= ~BIT(midx);
+
+	/* Hand over the hardware counter without waiting for the tick */
+	pmu_mux_schedule(phs, now);
+
+	return 0;
+}
+
+/**
+ * Select the first free multiplexed counter for a hardware event that
+ * did not get a hardware counter.
+ */
+static int pmu_mux_ctr_alloc(struct sbi_pmu_hart_state *phs,
+			     unsigned long cbase, unsigned long cmask,
+			     unsigned long flags, unsigned long event_idx,
+			     uint64_t data)
+{
+	struct sbi_pmu_mux_ctr *mctr;
+	int i, cidx;
+
+	if (!pmu_mux_event_supported(event_idx, data))
+		return SBI_ENOTSUPP;
+
+	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
+		cidx = i + cbase;
+		if (!pmu_ctr_is_mux(cidx) ||
+		    phs->active_events[cidx] != SBI_PMU_EVENT_IDX_INVALID)
+			continue;
+
+		mctr = &phs->mux_ctrs[pmu_mux_idx(cidx)];
+		sbi_memset(mctr, 0, sizeof(*mctr));
+		mctr->flags = flags;
+		mctr->data = data;
+		mctr->hw_cidx = -1;
+
+		return cidx;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+static void pmu_mux_reset(struct sbi_pmu_hart_state *phs)
+{
+	phs->mux_counters_started = 0;
+	phs->mux_counters_scheduled = 0;
+	phs->mux_next = 0;
+}
+
+int sbi_pmu_ctr_mux_get_time(uint32_t cidx, uint32_t type, uint64_t *time)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+	struct sbi_pmu_mux_ctr *mctr;
+	uint32_t midx;
+	uint64_t now;
+
+	if (unlikely(!phs))
+		return SBI_EINVAL;
+
+	if (!pmu_ctr_is_mux(cidx) ||
+	    phs->active_events[cidx] == SBI_PMU_EVENT_IDX_INVALID)
+		return SBI_EINVAL;
+
+	midx = pmu_mux_idx(cidx);
+	mctr = &phs->mux_ctrs[midx];
+	now = sbi_timer_value();
+
+	switch (type) {
+	case SBI_PMU_MUX_TIME_ENABLED:
+		*time = mctr->enabled_time;
+		if (phs->mux_counters_started & BIT(midx))
+			*time += now - mctr->enabled_stamp;
+		break;
+	case SBI_PMU_MUX_TIME_RUNNING:
+		*time = mctr->running_time;
+		if (mctr->hw_cidx >= 0)
+			*time += now - mctr->running_stamp;
+		break;
+	default:
+		return SBI_EINVAL;
+	}
+
+	return 0;
+}
+
+int sbi_pmu_ctr_mux_csr_read(int csr_num, unsigned long *csr_val)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+	uint32_t cidx, idx = csr_num - CSR_CYCLE;
+	uint64_t val;
+
+#if __riscv_xlen == 32
+	if (CSR_CYCLEH <= csr_num && csr_num < CSR_CYCLEH + SBI_PMU_HW_CTR_MAX)
+		idx = csr_num - CSR_CYCLEH;
+#endif
+	if (unlikely(!phs) || idx < pmu_mux_csr_idx(0) ||
+	    pmu_mux_csr_idx(num_mux_ctrs) <= idx)
+		return SBI_ENOTSUPP;
+
+	cidx = num_hw_ctrs + SBI_PMU_FW_CTR_MAX + idx - pmu_mux_csr_idx(0);
+	val = (phs->active_events[cidx] != SBI_PMU_EVENT_IDX_INVALID) ?
+	      pmu_mux_ctr_read(phs, cidx) : 0;
+
+#if __riscv_xlen == 32
+	if (csr_num >= CSR_CYCLEH)
+		val >>= 32;
+#endif
+	*csr_val = val;
+
+	return 0;
+}
+
+#else
+
+static inline uint64_t pmu_mux_ctr_read(struct sbi_pmu_hart_state *phs,
+					uint32_t cidx)
+{
+	return 0;
+}
+
+static inline void pmu_mux_ctr_write(struct sbi_pmu_hart_state *phs,
+				     uint32_t cidx, uint64_t ival) { }
+
+static inline int pmu_mux_ctr_start(struct sbi_pmu_hart_state *phs,
+				    uint32_t cidx, uint64_t ival,
+				    bool ival_update)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int pmu_mux_ctr_stop(struct sbi_pmu_hart_state *phs,
+				   uint32_t cidx)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int pmu_mux_ctr_alloc(struct sbi_pmu_hart_state *phs,
+				    unsigned long cbase, unsigned long cmask,
+				    unsigned long flags,
+				    unsigned long event_idx, uint64_t data)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void pmu_mux_reset(struct sbi_pmu_hart_state *phs) { }
+
+#endif
+
 int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 			  unsigned long flags, unsigned long event_idx,
 			  uint64_t event_data)
@@ -847,6 +1370,11 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 	} else {
 		ctr_idx = pmu_ctr_find_hw(phs, cidx_base, cidx_mask, flags,
 					  event_idx, event_data);
+		/* Multiplex the event if all hardware counters are in use */
+		if (ctr_idx < 0)
+			ctr_idx = pmu_mux_ctr_alloc(phs, cidx_base, cidx_mask,
+						    flags, event_idx,
+						    event_data);
 	}
 
 	if (ctr_idx < 0)
@@ -854,7 +1382,12 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 
 	phs->active_events[ctr_idx] = event_idx;
 skip_match:
-	if (event_type == SBI_PMU_EVENT_TYPE_HW) {
+	if (pmu_ctr_is_mux(ctr_idx)) {
+		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
+			pmu_mux_ctr_write(phs, ctr_idx, 0);
+		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
+			pmu_mux_ctr_start(phs, ctr_idx, 0, false);
+	} else if (event_type == SBI_PMU_EVENT_TYPE_HW) {
 		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
 			pmu_ctr_write_hw(ctr_idx, 0);
 		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
@@ -871,45 +1404,96 @@ skip_match:
 				if (ret)
 					return ret;
 			}
+			phs->fw_counters_overflown &= ~BIT(ctr_idx - num_hw_ctrs);
 			phs->fw_counters_started |= BIT(ctr_idx - num_hw_ctrs);
+			pmu_fw_event_map_set(phs, event_code,
+					     ctr_idx - num_hw_ctrs);
 		}
 	}
 
 	return ctr_idx;
 }
 
+static void pmu_ctr_overflow_fw(struct sbi_pmu_hart_state *phs, int fw_cidx)
+{
+	/* Like the OF bit of hardware counters, interrupt only once */
+	if (phs->fw_counters_overflown & BIT(fw_cidx))
+		return;
+	phs->fw_counters_overflown |= BIT(fw_cidx);
+
+	if (sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+				   SBI_HART_EXT_SSCOFPMF))
+		csr_set(CSR_MIP, MIP_LCOFIP);
+	else if (pmu_dev && pmu_dev->counter_overflow_raise_irq)
+		pmu_dev->counter_overflow_raise_irq();
+}
+
 int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id)
 {
-	u32 cidx;
-	uint64_t *fcounter = NULL;
+	unsigned long ctrs;
+	uint64_t *fcounter;
+	int i;
 	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
 
 	if (unlikely(!phs))
 		return 0;
 
-	if (likely(!phs->fw_counters_started))
+	if (unlikely(fw_id >= SBI_PMU_FW_MAX))
+		return SBI_EINVAL;
+
+	ctrs = phs->fw_event_counters[fw_id];
+	if (likely(!ctrs))
 		return 0;
 
-	if (unlikely(fw_id >= SBI_PMU_FW_MAX))
+	for_each_set_bit(i, &ctrs, SBI_PMU_FW_CTR_MAX) {
+		fcounter = &phs->fw_counters_data[i];
+		*fcounter = (*fcounter + 1) & fw_ctr_mask;
+		if (unlikely(!*fcounter))
+			pmu_ctr_overflow_fw(phs, i);
+	}
+
+	return 0;
+}
+
+int sbi_pmu_snapshot_set_shmem(const struct sbi_domain *dom,
+			       unsigned long smode,
+			       unsigned long shmem_phys_lo,
+			       unsigned long shmem_phys_hi,
+			       unsigned long flags)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+
+	if (unlikely(!phs))
 		return SBI_EINVAL;
 
-	for (cidx = num_hw_ctrs; cidx < total_ctrs; cidx++) {
-		if (get_cidx_code(phs->active_events[cidx]) == fw_id &&
-		    (phs->fw_counters_started & BIT(cidx - num_hw_ctrs))) {
-			fcounter = &phs->fw_counters_data[cidx - num_hw_ctrs];
-			break;
-		}
+	/* Disable the snapshot shared memory */
+	if (shmem_phys_lo == -1UL && shmem_phys_hi == -1UL) {
+		phs->snapshot_valid = false;
+		phs->snapshot = NULL;
+		return 0;
 	}
 
-	if (fcounter)
-		(*fcounter)++;
+	if (flags || (shmem_phys_lo & (SBI_PMU_SNAPSHOT_SIZE - 1)))
+		return SBI_EINVAL;
+
+	if (shmem_phys_hi ||
+	    !sbi_domain_check_addr_range(dom, shmem_phys_lo,
+					 SBI_PMU_SNAPSHOT_SIZE, smode,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	phs->snapshot = (struct sbi_pmu_snapshot *)shmem_phys_lo;
+	phs->snapshot_valid = true;
+	sbi_hart_map_saddr(shmem_phys_lo, SBI_PMU_SNAPSHOT_SIZE);
+	sbi_memset(phs->snapshot, 0, SBI_PMU_SNAPSHOT_SIZE);
+	sbi_hart_unmap_saddr();
 
 	return 0;
 }
 
 unsigned long sbi_pmu_num_ctr(void)
 {
-	return (num_hw_ctrs + SBI_PMU_FW_CTR_MAX);
+	return (num_hw_ctrs + SBI_PMU_FW_CTR_MAX + num_mux_ctrs);
 }
 
 int sbi_pmu_ctr_get_info(uint32_t cidx, unsigned long *ctr_info)
@@ -935,6 +1519,11 @@ int sbi_pmu_ctr_get_info(uint32_t cidx, unsigned long *ctr_info)
 			cinfo.width = 63;
 		else
 			cinfo.width = sbi_hart_mhpm_bits(scratch) - 1;
+	} else if (pmu_ctr_is_mux(cidx)) {
+		/* Reads of the CSR trap and return the accumulated value */
+		cinfo.type = SBI_PMU_CTR_TYPE_HW;
+		cinfo.csr = CSR_CYCLE + pmu_mux_csr_idx(pmu_mux_idx(cidx));
+		cinfo.width = 63;
 	} else {
 		/* it's a firmware counter */
 		cinfo.type = SBI_PMU_CTR_TYPE_FW;
@@ -962,6 +1551,12 @@ static void pmu_reset_event_map(struct sbi_pmu_hart_state *phs)
 	for (j = 0; j < SBI_PMU_FW_CTR_MAX; j++)
 		phs->fw_counters_data[j] = 0;
 	phs->fw_counters_started = 0;
+	phs->fw_counters_overflown = 0;
+	for (j = 0; j < SBI_PMU_FW_MAX; j++)
+		phs->fw_event_counters[j] = 0;
+	phs->snapshot_valid = false;
+	phs->snapshot = NULL;
+	pmu_mux_reset(phs);
 }
 
 const struct sbi_pmu_device *sbi_pmu_get_device(void)
@@ -1006,7 +1601,8 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (!hw_event_map)
 			return SBI_ENOMEM;
 
-		phs_ptr_offset = sbi_scratch_alloc_type_offset(void *);
+		phs_ptr_offset = sbi_scratch_alloc_type_offset_flags(void *,
+					SBI_SCRATCH_ALLOC_LOCAL_HOT);
 		if (!phs_ptr_offset) {
 			sbi_free(hw_event_map);
 			return SBI_ENOMEM;
@@ -1029,7 +1625,18 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 		if (num_hw_ctrs > SBI_PMU_HW_CTR_MAX)
 			return SBI_EINVAL;
 
-		total_ctrs = num_hw_ctrs + SBI_PMU_FW_CTR_MAX;
+		/* Firmware counters wrap at the width reported to supervisor */
+		if (pmu_dev && pmu_dev->fw_counter_width) {
+			rc = pmu_dev->fw_counter_width();
+			if (0 < rc && rc < 64)
+				fw_ctr_mask = (1ULL << rc) - 1;
+		}
+
+		/* Each multiplexed counter needs an unimplemented CSR */
+		num_mux_ctrs = MIN(SBI_PMU_MUX_CTR_MAX,
+				   SBI_PMU_HW_CTR_MAX - num_hw_ctrs);
+
+		total_ctrs = num_hw_ctrs + SBI_PMU_FW_CTR_MAX + num_mux_ctrs;
 	}
 
 	phs = pmu_get_hart_state_ptr(scratch);
@@ -1043,6 +1650,12 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 
 	pmu_reset_event_map(phs);
 
+	/* Make supervisor reads of multiplexed counter CSRs trap */
+	if (num_mux_ctrs &&
+	    sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_10)
+		csr_clear(CSR_MCOUNTEREN,
+			  ((1UL << num_mux_ctrs) - 1) << pmu_mux_csr_idx(0));
+
 	/* First three counters are fixed by the priv spec and we enable it by default */
 	phs->active_events[0] = (SBI_PMU_EVENT_TYPE_HW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) |
 				SBI_PMU_HW_CPU_CYCLES;
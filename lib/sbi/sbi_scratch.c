@@ -8,6 +8,7 @@
  */
 
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_platform.h>
@@ -18,8 +19,27 @@ u32 last_hartindex_having_scratch = 0;
 u32 hartindex_to_hartid_table[SBI_HARTMASK_MAX_BITS + 1] = { -1U };
 struct sbi_scratch *hartindex_to_scratch_table[SBI_HARTMASK_MAX_BITS + 1] = { 0 };
 
+/** Maximum number of live extra space allocations */
+#define SCRATCH_ALLOC_MAX		64
+
+/** Extra space allocation, the table is sorted by offset */
+struct scratch_alloc {
+	unsigned long offset;
+	unsigned long size;
+	unsigned long flags;
+	unsigned long caller;
+};
+
 static spinlock_t extra_lock = SPIN_LOCK_INITIALIZER;
-static unsigned long extra_offset = SBI_SCRATCH_EXTRA_SPACE_OFFSET;
+static struct scratch_alloc extra_allocs[SCRATCH_ALLOC_MAX] = {
+	/* Queue nodes of queued spinlocks, used before any allocation */
+	{
+		.offset = SBI_SCRATCH_QSPIN_NODES_OFFSET,
+		.size = SBI_SCRATCH_CACHE_LINE_SIZE,
+		.flags = SBI_SCRATCH_ALLOC_REMOTE_WRITTEN,
+	},
+};
+static u32 extra_alloc_count = 1;
 
 u32 sbi_hartid_to_hartindex(u32 hartid)
 {
@@ -51,35 +71,75 @@ int sbi_scratch_init(struct sbi_scratch *scratch)
 	return 0;
 }
 
-unsigned long sbi_scratch_alloc_offset(unsigned long size)
+/* Find the space between allocations at index - 1 and index */
+static void scratch_alloc_gap(u32 index, unsigned long *start,
+			      unsigned long *end)
 {
-	u32 i;
+	*start = (index) ? extra_allocs[index - 1].offset +
+			   extra_allocs[index - 1].size :
+			   SBI_SCRATCH_EXTRA_SPACE_OFFSET;
+	*end = (index < extra_alloc_count) ?
+		extra_allocs[index].offset : SBI_SCRATCH_SIZE;
+}
+
+static unsigned long scratch_alloc(unsigned long size, unsigned long flags,
+				   unsigned long caller)
+{
+	u32 i, pos = 0;
 	void *ptr;
-	unsigned long ret = 0;
+	unsigned long start, end, align, off, ret = 0;
 	struct sbi_scratch *rscratch;
 
-	/*
-	 * We have a simple brain-dead allocator which never expects
-	 * anything to be free-ed hence it keeps incrementing the
-	 * next allocation offset until it runs-out of space.
-	 *
-	 * In future, we will have more sophisticated allocator which
-	 * will allow us to re-claim free-ed space.
-	 */
-
 	if (!size)
 		return 0;
 
-	size += __SIZEOF_POINTER__ - 1;
-	size &= ~((unsigned long)__SIZEOF_POINTER__ - 1);
+	/*
+	 * Remote written allocations cover whole cache lines so that no
+	 * other allocation shares a line with them. This assumes each
+	 * sbi_scratch is cache line aligned, which holds because it sits
+	 * at the top of a page aligned HART stack.
+	 */
+	align = (flags & SBI_SCRATCH_ALLOC_REMOTE_WRITTEN) ?
+		SBI_SCRATCH_CACHE_LINE_SIZE : __SIZEOF_POINTER__;
+	size = ROUNDUP(size, align);
 
 	spin_lock(&extra_lock);
 
-	if (SBI_SCRATCH_SIZE < (extra_offset + size))
+	if (extra_alloc_count == SCRATCH_ALLOC_MAX)
 		goto done;
 
-	ret = extra_offset;
-	extra_offset += size;
+	/*
+	 * Local hot allocations take the lowest fitting space, next to
+	 * the sbi_scratch fields used on every trap. Everything else
+	 * takes the highest fitting space.
+	 */
+	for (i = 0; i <= extra_alloc_count; i++) {
+		scratch_alloc_gap(i, &start, &end);
+		start = ROUNDUP(start, align);
+		if (end < start || (end - start) < size)
+			continue;
+
+		if (flags & SBI_SCRATCH_ALLOC_LOCAL_HOT)
+			off = start;
+		else
+			off = ROUNDDOWN(end - size, align);
+		if (!ret || !(flags & SBI_SCRATCH_ALLOC_LOCAL_HOT)) {
+			ret = off;
+			pos = i;
+		}
+		if (flags & SBI_SCRATCH_ALLOC_LOCAL_HOT)
+			break;
+	}
+	if (!ret)
+		goto done;
+
+	sbi_memmove(&extra_allocs[pos + 1], &extra_allocs[pos],
+		    (extra_alloc_count - pos) * sizeof(extra_allocs[0]));
+	extra_allocs[pos].offset = ret;
+	extra_allocs[pos].size = size;
+	extra_allocs[pos].flags = flags;
+	extra_allocs[pos].caller = caller;
+	extra_alloc_count++;
 
 done:
 	spin_unlock(&extra_lock);
@@ -97,25 +157,82 @@ done:
 	return ret;
 }
 
+unsigned long sbi_scratch_alloc_offset(unsigned long size)
+{
+	return scratch_alloc(size, 0,
+			     (unsigned long)__builtin_return_address(0));
+}
+
+unsigned long sbi_scratch_alloc_offset_flags(unsigned long size,
+					     unsigned long flags)
+{
+	return scratch_alloc(size, flags,
+			     (unsigned long)__builtin_return_address(0));
+}
+
 void sbi_scratch_free_offset(unsigned long offset)
 {
+	u32 i;
+
 	if ((offset < SBI_SCRATCH_EXTRA_SPACE_OFFSET) ||
 	    (SBI_SCRATCH_SIZE <= offset))
 		return;
 
-	/*
-	 * We don't actually free-up because it's a simple
-	 * brain-dead allocator.
-	 */
+	spin_lock(&extra_lock);
+
+	for (i = 0; i < extra_alloc_count; i++) {
+		if (extra_allocs[i].offset != offset)
+			continue;
+
+		extra_alloc_count--;
+		sbi_memmove(&extra_allocs[i], &extra_allocs[i + 1],
+			    (extra_alloc_count - i) * sizeof(extra_allocs[0]));
+		break;
+	}
+
+	spin_unlock(&extra_lock);
 }
 
 unsigned long sbi_scratch_used_space(void)
 {
-	unsigned long ret = 0;
+	unsigned long ret = SBI_SCRATCH_EXTRA_SPACE_OFFSET;
+	u32 i;
 
 	spin_lock(&extra_lock);
-	ret = extra_offset;
+	for (i = 0; i < extra_alloc_count; i++)
+		ret += extra_allocs[i].size;
 	spin_unlock(&extra_lock);
 
 	return ret;
 }
+
+void sbi_scratch_dump_layout(void)
+{
+	unsigned long start, end;
+	const char *kind;
+	u32 i;
+
+	spin_lock(&extra_lock);
+
+	for (i = 0; i <= extra_alloc_count; i++) {
+		scratch_alloc_gap(i, &start, &end);
+		if (start < end)
+			sbi_printf("Scratch 0x%03lx-0x%03lx : free\n",
+				   start, end - 1);
+		if (i == extra_alloc_count)
+			break;
+
+		if (extra_allocs[i].flags & SBI_SCRATCH_ALLOC_REMOTE_WRITTEN)
+			kind = "remote";
+		else if (extra_allocs[i].flags & SBI_SCRATCH_ALLOC_LOCAL_HOT)
+			kind = "hot";
+		else
+			kind = "normal";
+		sbi_printf("Scratch 0x%03lx-0x%03lx : %s (caller 0x%lx)\n",
+			   extra_allocs[i].offset,
+			   extra_allocs[i].offset + extra_allocs[i].size - 1,
+			   kind, extra_allocs[i].caller);
+	}
+
+	spin_unlock(&extra_lock);
+}
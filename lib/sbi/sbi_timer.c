@@ -19,6 +19,7 @@
 #include <sbi/sbi_timer.h>
 
 static unsigned long time_delta_off;
+static unsigned long time_next_event_off;
 static u64 (*get_time_val)(void);
 static const struct sbi_timer_device *timer_dev = NULL;
 
@@ -129,9 +130,31 @@ void sbi_timer_set_delta_upper(ulong delta_upper)
 	*time_delta |= ((u64)delta_upper << 32);
 }
 
+u64 sbi_timer_next_event(void)
+{
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	u64 *next = sbi_scratch_offset_ptr(scratch, time_next_event_off);
+
+	/* Supervisor may program stimecmp directly without trapping */
+	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_SSTC)) {
+#if __riscv_xlen == 32
+		return ((u64)csr_read(CSR_STIMECMPH) << 32) |
+		       csr_read(CSR_STIMECMP);
+#else
+		return csr_read(CSR_STIMECMP);
+#endif
+	}
+
+	return *next;
+}
+
 void sbi_timer_event_start(u64 next_event)
 {
+	u64 *next = sbi_scratch_offset_ptr(sbi_scratch_thishart_ptr(),
+					   time_next_event_off);
+
 	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SET_TIMER);
+	*next = next_event;
 
 	/**
 	 * Update the stimecmp directly if available. This allows
@@ -151,9 +174,31 @@ void sbi_timer_event_start(u64 next_event)
 	csr_set(CSR_MIE, MIP_MTIP);
 }
 
+int sbi_timer_mmode_event_start(u64 next_event)
+{
+	if (!sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+				    SBI_HART_EXT_SSTC) ||
+	    !timer_dev || !timer_dev->timer_event_start)
+		return SBI_ENOTSUPP;
+
+	timer_dev->timer_event_start(next_event);
+	csr_set(CSR_MIE, MIP_MTIP);
+
+	return 0;
+}
+
 void sbi_timer_process(void)
 {
+	u64 *next = sbi_scratch_offset_ptr(sbi_scratch_thishart_ptr(),
+					   time_next_event_off);
+
+	*next = -1ULL;
 	csr_clear(CSR_MIE, MIP_MTIP);
+
+	/* Use the tick to write buffered console messages */
+	sbi_console_drain();
+	/* Give waiting multiplexed PMU counters their turn */
+	sbi_pmu_mux_rotate();
 	/*
 	 * If sstc extension is available, supervisor can receive the timer
 	 * directly without M-mode come in between. This function should
@@ -180,24 +225,32 @@ void sbi_timer_set_device(const struct sbi_timer_device *dev)
 
 int sbi_timer_init(struct sbi_scratch *scratch, bool cold_boot)
 {
-	u64 *time_delta;
+	u64 *time_delta, *next_event;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
 
 	if (cold_boot) {
-		time_delta_off = sbi_scratch_alloc_offset(sizeof(*time_delta));
+		time_delta_off = sbi_scratch_alloc_offset_flags(sizeof(*time_delta),
+					SBI_SCRATCH_ALLOC_LOCAL_HOT);
 		if (!time_delta_off)
 			return SBI_ENOMEM;
 
+		time_next_event_off = sbi_scratch_alloc_offset(sizeof(*next_event));
+		if (!time_next_event_off)
+			return SBI_ENOMEM;
+
 		if (sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICNTR))
 			get_time_val = get_ticks;
 	} else {
-		if (!time_delta_off)
+		if (!time_delta_off || !time_next_event_off)
 			return SBI_ENOMEM;
 	}
 
 	time_delta = sbi_scratch_offset_ptr(scratch, time_delta_off);
 	*time_delta = 0;
 
+	next_event = sbi_scratch_offset_ptr(scratch, time_next_event_off);
+	*next_event = -1ULL;
+
 	return sbi_platform_timer_init(plat, cold_boot);
 }
 
@@ -23,6 +23,8 @@
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_pmu.h>
+#include <sbi/sbi_trace.h>
+#include <sbi/sbi_wait.h>
 
 static unsigned long tlb_sync_off;
 static unsigned long tlb_fifo_off;
@@ -181,6 +183,9 @@ static void tlb_entry_local_process(struct sbi_tlb_info *data)
 	if (unlikely(!data))
 		return;
 
+	sbi_trace(SBI_TRACE_RFENCE, data->type, data->start, data->size,
+		  ((u32)data->vmid << 16) | data->asid);
+
 	switch (data->type) {
 	case SBI_TLB_FENCE_I:
 		sbi_tlb_local_fence_i(data);
@@ -249,13 +254,18 @@ static void tlb_sync(struct sbi_scratch *scratch)
 {
 	atomic_t *tlb_sync =
 			sbi_scratch_offset_ptr(scratch, tlb_sync_off);
+	struct sbi_wait_state ws = SBI_WAIT_STATE_INIT(false);
+	long pending;
 
-	while (atomic_read(tlb_sync) > 0) {
+	while ((pending = atomic_read(tlb_sync)) > 0) {
 		/*
 		 * While we are waiting for remote hart to set the sync,
-		 * consume fifo requests to avoid deadlock.
+		 * consume fifo requests to avoid deadlock. Remote harts
+		 * queueing requests also send an IPI which ends the wait.
 		 */
-		tlb_process_once(scratch);
+		if (!tlb_process_once(scratch))
+			sbi_wait_relax(&ws, &tlb_sync->counter,
+				       sizeof(tlb_sync->counter), pending);
 	}
 
 	return;
@@ -420,15 +430,18 @@ int sbi_tlb_init(struct sbi_scratch *scratch, bool cold_boot)
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
 
 	if (cold_boot) {
-		tlb_sync_off = sbi_scratch_alloc_offset(sizeof(*tlb_sync));
+		tlb_sync_off = sbi_scratch_alloc_offset_flags(sizeof(*tlb_sync),
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
 		if (!tlb_sync_off)
 			return SBI_ENOMEM;
-		tlb_fifo_off = sbi_scratch_alloc_offset(sizeof(*tlb_q));
+		tlb_fifo_off = sbi_scratch_alloc_offset_flags(sizeof(*tlb_q),
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
 		if (!tlb_fifo_off) {
 			sbi_scratch_free_offset(tlb_sync_off);
 			return SBI_ENOMEM;
 		}
-		tlb_fifo_mem_off = sbi_scratch_alloc_offset(sizeof(tlb_mem));
+		tlb_fifo_mem_off = sbi_scratch_alloc_offset_flags(sizeof(tlb_mem),
+					SBI_SCRATCH_ALLOC_REMOTE_WRITTEN);
 		if (!tlb_fifo_mem_off) {
 			sbi_scratch_free_offset(tlb_fifo_off);
 			sbi_scratch_free_offset(tlb_sync_off);
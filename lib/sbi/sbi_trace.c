@@ -0,0 +1,134 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#include <sbi/riscv_barrier.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_timer.h>
+#include <sbi/sbi_trace.h>
+
+/* Bytes of a trace ring printed per console line */
+#define TRACE_DUMP_LINE_BYTES	32
+
+static unsigned long trace_ring_offset;
+
+void __sbi_trace(u32 event, u64 arg0, u64 arg1, u64 arg2, u64 arg3)
+{
+	struct sbi_trace_record *rec;
+	struct sbi_trace_ring *ring;
+
+	if (!trace_ring_offset)
+		return;
+
+	ring = sbi_scratch_read_type(sbi_scratch_thishart_ptr(), void *,
+				     trace_ring_offset);
+	if (!ring)
+		return;
+
+	/*
+	 * Only the owner HART writes its ring and M-mode is not
+	 * interrupted, so no locking is needed. The head is published
+	 * after the record for readers of a live ring.
+	 */
+	rec = &ring->records[ring->head & (ring->nr_records - 1)];
+	rec->time = sbi_timer_value();
+	rec->hartid = ring->hartid;
+	rec->event = event;
+	rec->args[0] = arg0;
+	rec->args[1] = arg1;
+	rec->args[2] = arg2;
+	rec->args[3] = arg3;
+	smp_wmb();
+	ring->head++;
+}
+
+static void trace_dump_ring(struct sbi_trace_ring *ring)
+{
+	static const char hex[] = "0123456789abcdef";
+	char line[TRACE_DUMP_LINE_BYTES * 2 + 1];
+	unsigned long i, size;
+	const u8 *data = (const u8 *)ring;
+	u32 j;
+
+	size = sizeof(*ring) + ring->nr_records * sizeof(ring->records[0]);
+	for (i = 0; i < size; i += TRACE_DUMP_LINE_BYTES) {
+		for (j = 0; j < TRACE_DUMP_LINE_BYTES && (i + j) < size; j++) {
+			line[2 * j] = hex[data[i + j] >> 4];
+			line[2 * j + 1] = hex[data[i + j] & 0xf];
+		}
+		line[2 * j] = '\0';
+		sbi_printf("SBITRACE %s\n", line);
+	}
+}
+
+void sbi_trace_dump(void)
+{
+	struct sbi_trace_ring *ring;
+	struct sbi_scratch *rscratch;
+	u32 i;
+
+	if (!trace_ring_offset)
+		return;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+
+		ring = sbi_scratch_read_type(rscratch, void *,
+					     trace_ring_offset);
+		if (ring)
+			trace_dump_ring(ring);
+	}
+}
+
+int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	struct sbi_trace_ring *ring;
+	struct sbi_scratch *rscratch;
+	unsigned long offset;
+	u32 i;
+
+	if (!cold_boot)
+		return 0;
+
+	offset = sbi_scratch_alloc_type_offset_flags(void *,
+					SBI_SCRATCH_ALLOC_LOCAL_HOT);
+	if (!offset)
+		return SBI_ENOMEM;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+
+		ring = sbi_zalloc(sizeof(*ring) + SBI_TRACE_RING_RECORDS *
+				  sizeof(ring->records[0]));
+		if (!ring) {
+			sbi_printf("%s: no trace ring for hart %u\n",
+				   __func__, sbi_hartindex_to_hartid(i));
+			sbi_scratch_write_type(rscratch, void *, offset, NULL);
+			continue;
+		}
+
+		ring->magic = SBI_TRACE_MAGIC;
+		ring->version = SBI_TRACE_VERSION;
+		ring->record_size = sizeof(ring->records[0]);
+		ring->hartid = sbi_hartindex_to_hartid(i);
+		ring->nr_records = SBI_TRACE_RING_RECORDS;
+		ring->timer_freq = (tdev) ? tdev->timer_freq : 0;
+		sbi_scratch_write_type(rscratch, void *, offset, ring);
+	}
+
+	/* Start tracing once all rings are set up */
+	smp_wmb();
+	trace_ring_offset = offset;
+
+	return 0;
+}
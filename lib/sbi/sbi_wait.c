@@ -0,0 +1,75 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_wait.h>
+
+/* Upper limit of backoff (log2 of PAUSE instructions) */
+#define WAIT_BACKOFF_MAX	6
+
+static void wait_wrs(volatile void *ptr, unsigned int size, unsigned long old)
+{
+	unsigned long tmp;
+
+	/* Register a reservation and stall unless the value changed */
+	if (size == 4) {
+		__asm__ __volatile__(
+			"	lr.w	%0, %1\n"
+			"	bne	%0, %2, 1f\n"
+			"	.word	%3\n"
+			"1:"
+			: "=&r"(tmp)
+			: "A"(*(volatile u32 *)ptr), "r"((long)(s32)old),
+			  "i"(INSN_MATCH_WRS_NTO)
+			: "memory");
+	} else {
+		__asm__ __volatile__(
+#if __riscv_xlen == 64
+			"	lr.d	%0, %1\n"
+#else
+			"	lr.w	%0, %1\n"
+#endif
+			"	bne	%0, %2, 1f\n"
+			"	.word	%3\n"
+			"1:"
+			: "=&r"(tmp)
+			: "A"(*(volatile unsigned long *)ptr), "r"(old),
+			  "i"(INSN_MATCH_WRS_NTO)
+			: "memory");
+	}
+}
+
+void sbi_wait_relax(struct sbi_wait_state *ws, volatile void *ptr,
+		    unsigned int size, unsigned long old)
+{
+	unsigned int i;
+
+	if (!ws->probed) {
+		ws->wrs = ptr && (size == 4 || size == sizeof(long)) &&
+			  !((unsigned long)ptr & (size - 1)) &&
+			  sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+						 SBI_HART_EXT_ZAWRS);
+		ws->probed = true;
+	}
+
+	if (ws->wrs) {
+		wait_wrs(ptr, size, old);
+		return;
+	}
+
+	if (ws->idle) {
+		wfi();
+		return;
+	}
+
+	for (i = 0; i < (1U << ws->backoff); i++)
+		pause();
+	if (ws->backoff < WAIT_BACKOFF_MAX)
+		ws->backoff++;
+}
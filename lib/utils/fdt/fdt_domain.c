@@ -16,7 +16,9 @@
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi_utils/fdt/fdt_domain.h>
+#include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
 
 int fdt_iterate_each_domain(void *fdt, void *opaque,
 			    int (*fn)(void *fdt, int domain_offset,
@@ -107,22 +109,6 @@ static int __fixup_find_domain_offset(void *fdt, int doff, void *p)
 				 SBI_DOMAIN_MEMREGION_WRITEABLE | \
 				 SBI_DOMAIN_MEMREGION_EXECUTABLE)
 
-static int __fixup_count_disable_devices(void *fdt, int doff, int roff,
-					 u32 perm, void *p)
-{
-	int len;
-	u32 *dcount = p;
-
-	if (perm & DISABLE_DEVICES_MASK)
-		return 0;
-
-	len = 0;
-	if (fdt_getprop(fdt, roff, "devices", &len))
-		*dcount += len / sizeof(u32);
-
-	return 0;
-}
-
 static int __fixup_disable_devices(void *fdt, int doff, int roff,
 				   u32 raccess, void *p)
 {
@@ -139,12 +125,12 @@ static int __fixup_disable_devices(void *fdt, int doff, int roff,
 	len = len / sizeof(u32);
 
 	for (i = 0; i < len; i++) {
-		coff = fdt_node_offset_by_phandle(fdt,
+		coff = fdt_index_node_offset_by_phandle(fdt,
 					fdt32_to_cpu(devices[i]));
 		if (coff < 0)
 			return coff;
 
-		fdt_setprop_string(fdt, coff, "status", "disabled");
+		fdt_fixup_setprop_string(fdt, coff, "status", "disabled");
 	}
 
 	return 0;
@@ -152,7 +138,7 @@ static int __fixup_disable_devices(void *fdt, int doff, int roff,
 
 void fdt_domain_fixup(void *fdt)
 {
-	u32 i, dcount;
+	u32 i;
 	int err, poffset, doffset;
 	struct sbi_domain *dom = sbi_domain_thishart_ptr();
 	struct __fixup_find_domain_offset_info fdo;
@@ -161,15 +147,20 @@ void fdt_domain_fixup(void *fdt)
 	poffset = fdt_path_offset(fdt, "/cpus");
 	if (poffset < 0)
 		return;
+
+	/* Node offsets stay valid until all edits are emitted at the end */
+	if (fdt_fixup_begin(fdt))
+		return;
+
 	fdt_for_each_subnode(doffset, fdt, poffset) {
 		err = fdt_parse_hart_id(fdt, doffset, &i);
 		if (err)
 			continue;
 
-		if (!fdt_node_is_enabled(fdt, doffset))
+		if (!fdt_fixup_node_is_enabled(fdt, doffset))
 			continue;
 
-		fdt_nop_property(fdt, doffset, "opensbi-domain");
+		fdt_fixup_delprop(fdt, doffset, "opensbi-domain");
 	}
 
 	/* Skip device disable for root domain */
@@ -184,26 +175,6 @@ void fdt_domain_fixup(void *fdt)
 	if (doffset < 0)
 		goto skip_device_disable;
 
-	/* Count current domain device DT nodes to be disabled */
-	dcount = 0;
-	fdt_iterate_each_memregion(fdt, doffset, &dcount,
-				   __fixup_count_disable_devices);
-	if (!dcount)
-		goto skip_device_disable;
-
-	/* Expand FDT based on device DT nodes to be disabled */
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + dcount * 32);
-	if (err < 0)
-		return;
-
-	/* Again find current domain DT node */
-	doffset = -1;
-	fdo.name = dom->name;
-	fdo.doffset = &doffset;
-	fdt_iterate_each_domain(fdt, &fdo, __fixup_find_domain_offset);
-	if (doffset < 0)
-		goto skip_device_disable;
-
 	/* Disable device DT nodes for current domain */
 	fdt_iterate_each_memregion(fdt, doffset, NULL,
 				   __fixup_disable_devices);
@@ -211,13 +182,13 @@ skip_device_disable:
 
 	/* Remove the OpenSBI domain config DT node */
 	poffset = fdt_path_offset(fdt, "/chosen");
-	if (poffset < 0)
-		return;
-	poffset = fdt_node_offset_by_compatible(fdt, poffset,
+	if (poffset >= 0)
+		poffset = fdt_index_node_offset_by_compatible(fdt, poffset,
 						"opensbi,domain,config");
-	if (poffset < 0)
-		return;
-	fdt_nop_node(fdt, poffset);
+	if (poffset >= 0)
+		fdt_fixup_del_node(fdt, poffset);
+
+	fdt_fixup_end(fdt);
 }
 
 #define FDT_DOMAIN_REGION_MAX_COUNT	16
@@ -439,6 +410,19 @@ static int __fdt_parse_domain(void *fdt, int domain_offset, void *opaque)
 	else
 		dom->system_suspend_allowed = false;
 
+	/* Read "context-isolation" DT property */
+	dom->context_flags = 0;
+	val = fdt_getprop(fdt, domain_offset, "context-isolation", &len);
+	if (val && len > 0) {
+		if (fdt_stringlist_contains((const char *)val, len, "fp"))
+			dom->context_flags |= SBI_DOMAIN_CTX_ISOLATE_FP;
+		if (fdt_stringlist_contains((const char *)val, len, "vector"))
+			dom->context_flags |= SBI_DOMAIN_CTX_ISOLATE_VECTOR;
+		if (fdt_stringlist_contains((const char *)val,
+					    len, "hypervisor"))
+			dom->context_flags |= SBI_DOMAIN_CTX_ISOLATE_HYP;
+	}
+
 	/* Find /cpus DT node */
 	cpus_offset = fdt_path_offset(fdt, "/cpus");
 	if (cpus_offset < 0) {
@@ -9,22 +9,672 @@
  */
 
 #include <libfdt.h>
+#include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_domain.h>
 #include <sbi/sbi_math.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_error.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_pmu.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
+
+/* Maximum depth of nodes in a FDT emitted by a batch of fix-ups */
+#define FDT_FIXUP_MAX_DEPTH	32
+
+/* Flag of the handles of nodes added by a batch of fix-ups */
+#define FDT_FIXUP_NEW_NODE	0x40000000
+
+/* Size of the chunks holding the edits of a batch of fix-ups */
+#define FDT_FIXUP_CHUNK_SIZE	2048
+
+#define FDT_FIXUP_ALIGN(x)	BIT_ALIGN(x, FDT_TAGSIZE)
+
+enum fdt_fixup_edit_type {
+	FDT_FIXUP_SETPROP = 0,
+	FDT_FIXUP_DELPROP,
+	FDT_FIXUP_ADD_NODE,
+	FDT_FIXUP_DEL_NODE,
+	/* Property edit overridden by a later edit */
+	FDT_FIXUP_DEAD,
+};
+
+struct fdt_fixup_edit {
+	struct fdt_fixup_edit *next;
+	/* Offset of the node in the FDT or handle of a new node */
+	int node;
+	int type;
+	/* Length of the property value or handle of the added node */
+	int len;
+	/* Offset of the property name in the emitted strings block */
+	int nameoff;
+	const char *name;
+	const void *data;
+};
+
+struct fdt_fixup_chunk {
+	struct fdt_fixup_chunk *next;
+	unsigned long used;
+	unsigned long size;
+	unsigned long mem[];
+};
+
+static struct {
+	void *fdt;
+	int depth;
+	int error;
+	int new_nodes;
+	/* Upper bound of the growth of the FDT when emitted */
+	unsigned long grow;
+	/* Recorded edits, the latest one first */
+	struct fdt_fixup_edit *edits;
+	struct fdt_fixup_chunk *chunks;
+} fixup;
+
+static void *fdt_fixup_alloc(unsigned long size)
+{
+	struct fdt_fixup_chunk *chunk = fixup.chunks;
+	unsigned long csize;
+	void *ptr;
+
+	size = BIT_ALIGN(size, sizeof(unsigned long));
+	if (!chunk || chunk->size - chunk->used < size) {
+		csize = (size > FDT_FIXUP_CHUNK_SIZE - sizeof(*chunk)) ?
+			size + sizeof(*chunk) : FDT_FIXUP_CHUNK_SIZE;
+		chunk = sbi_malloc(csize);
+		if (!chunk)
+			return NULL;
+		chunk->used = 0;
+		chunk->size = csize - sizeof(*chunk);
+		chunk->next = fixup.chunks;
+		fixup.chunks = chunk;
+	}
+
+	ptr = (char *)chunk->mem + chunk->used;
+	chunk->used += size;
+
+	return ptr;
+}
+
+/* Copy names and values, sharing them between consecutive edits */
+static const void *fdt_fixup_copy(const void *data, int len, bool name)
+{
+	const struct fdt_fixup_edit *last = fixup.edits;
+	void *ptr;
+
+	if (last && name && last->name && !strcmp(last->name, data))
+		return last->name;
+	if (last && !name && last->data && last->len == len &&
+	    !memcmp(last->data, data, len))
+		return last->data;
+
+	ptr = fdt_fixup_alloc(len);
+	if (ptr)
+		memcpy(ptr, data, len);
+
+	return ptr;
+}
+
+static bool fdt_fixup_node_valid(void *fdt, int nodeoff)
+{
+	if (nodeoff < 0)
+		return false;
+
+	if (nodeoff & FDT_FIXUP_NEW_NODE)
+		return (nodeoff & ~FDT_FIXUP_NEW_NODE) < fixup.new_nodes;
+
+	return fdt_get_name(fdt, nodeoff, NULL) ? true : false;
+}
+
+static int fdt_fixup_record(void *fdt, int type, int nodeoff,
+			    const char *name, const void *val, int len)
+{
+	struct fdt_fixup_edit *e;
+
+	if (!fixup.depth || fdt != fixup.fdt || len < 0 ||
+	    !fdt_fixup_node_valid(fdt, nodeoff))
+		return SBI_EINVAL;
+	if (fixup.error)
+		return fixup.error;
+
+	e = fdt_fixup_alloc(sizeof(*e));
+	if (!e)
+		goto fail;
+	e->node = nodeoff;
+	e->type = type;
+	e->len = len;
+	e->nameoff = 0;
+	e->name = NULL;
+	e->data = NULL;
+	if (name) {
+		e->name = fdt_fixup_copy(name, strlen(name) + 1, true);
+		if (!e->name)
+			goto fail;
+	}
+	if (type == FDT_FIXUP_SETPROP && len) {
+		e->data = fdt_fixup_copy(val, len, false);
+		if (!e->data)
+			goto fail;
+	}
+
+	if (type == FDT_FIXUP_SETPROP)
+		fixup.grow += sizeof(struct fdt_property) +
+			      FDT_FIXUP_ALIGN(len) + strlen(name) + 1;
+	else if (type == FDT_FIXUP_ADD_NODE)
+		fixup.grow += 2 * FDT_TAGSIZE + FDT_FIXUP_ALIGN(strlen(name) + 1);
+
+	e->next = fixup.edits;
+	fixup.edits = e;
+
+	return 0;
+
+fail:
+	fixup.error = SBI_ENOMEM;
+	return SBI_ENOMEM;
+}
+
+int fdt_fixup_setprop(void *fdt, int nodeoff, const char *name,
+		      const void *val, int len)
+{
+	if (!name || (len && !val))
+		return SBI_EINVAL;
+
+	return fdt_fixup_record(fdt, FDT_FIXUP_SETPROP, nodeoff,
+				name, val, len);
+}
+
+int fdt_fixup_delprop(void *fdt, int nodeoff, const char *name)
+{
+	if (!name)
+		return SBI_EINVAL;
+
+	return fdt_fixup_record(fdt, FDT_FIXUP_DELPROP, nodeoff,
+				name, NULL, 0);
+}
+
+int fdt_fixup_add_subnode(void *fdt, int parentoff, const char *name)
+{
+	const struct fdt_fixup_edit *e;
+	int rc, handle;
+
+	if (!name || !*name || !fdt_fixup_node_valid(fdt, parentoff))
+		return SBI_EINVAL;
+
+	if (!(parentoff & FDT_FIXUP_NEW_NODE) &&
+	    fdt_subnode_offset(fdt, parentoff, name) >= 0)
+		return SBI_EALREADY;
+	for (e = fixup.edits; e; e = e->next) {
+		if (e->type == FDT_FIXUP_ADD_NODE && e->node == parentoff &&
+		    !strcmp(e->name, name))
+			return SBI_EALREADY;
+	}
+
+	handle = FDT_FIXUP_NEW_NODE | fixup.new_nodes;
+	rc = fdt_fixup_record(fdt, FDT_FIXUP_ADD_NODE, parentoff,
+			      name, NULL, handle);
+	if (rc)
+		return rc;
+	fixup.new_nodes++;
+
+	return handle;
+}
+
+int fdt_fixup_del_node(void *fdt, int nodeoff)
+{
+	return fdt_fixup_record(fdt, FDT_FIXUP_DEL_NODE, nodeoff,
+				NULL, NULL, 0);
+}
+
+bool fdt_fixup_node_is_enabled(void *fdt, int nodeoff)
+{
+	const struct fdt_fixup_edit *e;
+	const void *prop;
+
+	for (e = fixup.edits; e; e = e->next) {
+		if (e->node != nodeoff || strcmp(e->name ? e->name : "",
+						 "status"))
+			continue;
+		if (e->type == FDT_FIXUP_DELPROP)
+			return true;
+		if (e->type == FDT_FIXUP_SETPROP)
+			break;
+	}
+
+	if (!e)
+		return fdt_node_is_enabled(fdt, nodeoff);
+
+	prop = e->data;
+	if (!prop)
+		return false;
+
+	if (!strncmp(prop, "okay", strlen("okay")))
+		return true;
+
+	if (!strncmp(prop, "ok", strlen("ok")))
+		return true;
+
+	return false;
+}
+
+int fdt_fixup_begin(void *fdt)
+{
+	if (!fdt)
+		return SBI_EINVAL;
+
+	if (fixup.depth) {
+		if (fdt != fixup.fdt)
+			return SBI_EINVAL;
+		fixup.depth++;
+		return 0;
+	}
+
+	fixup.fdt = fdt;
+	fixup.depth = 1;
+	fixup.error = 0;
+	fixup.new_nodes = 0;
+	fixup.grow = 0;
+	fixup.edits = NULL;
+	fixup.chunks = NULL;
+
+	return 0;
+}
+
+/* Stable merge sort of edits by node */
+static struct fdt_fixup_edit *fdt_fixup_sort(struct fdt_fixup_edit *list)
+{
+	struct fdt_fixup_edit *a, *b, *slow, *fast, head, *tail;
+
+	if (!list || !list->next)
+		return list;
+
+	slow = list;
+	fast = list->next;
+	while (fast && fast->next) {
+		slow = slow->next;
+		fast = fast->next->next;
+	}
+	b = slow->next;
+	slow->next = NULL;
+	a = fdt_fixup_sort(list);
+	b = fdt_fixup_sort(b);
+
+	tail = &head;
+	while (a && b) {
+		if (b->node < a->node) {
+			tail->next = b;
+			b = b->next;
+		} else {
+			tail->next = a;
+			a = a->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = a ? a : b;
+
+	return head.next;
+}
+
+/* First edit of a node, searching forward from *cursor */
+static struct fdt_fixup_edit *fdt_fixup_group(struct fdt_fixup_edit **cursor,
+					      int node)
+{
+	struct fdt_fixup_edit *e = *cursor;
+
+	while (e && e->node < node)
+		e = e->next;
+	*cursor = e;
+
+	return (e && e->node == node) ? e : NULL;
+}
+
+static struct fdt_fixup_edit *fdt_fixup_find_prop(struct fdt_fixup_edit *group,
+						  const char *name)
+{
+	struct fdt_fixup_edit *e;
+
+	for (e = group; e && e->node == group->node; e = e->next) {
+		if ((e->type == FDT_FIXUP_SETPROP ||
+		     e->type == FDT_FIXUP_DELPROP) && !strcmp(e->name, name))
+			return e;
+	}
+
+	return NULL;
+}
+
+/*
+ * Drop property edits overridden by later ones and assign property name
+ * offsets, appending names missing from the strings block.
+ */
+static int fdt_fixup_resolve(struct fdt_fixup_edit *edits,
+			     const char *strs, int strs_size)
+{
+	struct fdt_fixup_edit *e, *p, *group = NULL;
+	const char *prev = NULL, *s;
+	int size = strs_size, prevoff = 0;
+
+	for (e = edits; e; e = e->next) {
+		if (!group || group->node != e->node)
+			group = e;
+		if (e->type != FDT_FIXUP_SETPROP &&
+		    e->type != FDT_FIXUP_DELPROP)
+			continue;
+		if (fdt_fixup_find_prop(group, e->name) != e) {
+			e->type = FDT_FIXUP_DEAD;
+			continue;
+		}
+		if (e->type != FDT_FIXUP_SETPROP)
+			continue;
+
+		if (e->name == prev) {
+			e->nameoff = prevoff;
+			continue;
+		}
+
+		e->nameoff = -1;
+		for (s = strs; s < strs + strs_size; s += strlen(s) + 1) {
+			if (!strcmp(s, e->name)) {
+				e->nameoff = s - strs;
+				break;
+			}
+		}
+		for (p = edits; e->nameoff < 0 && p != e; p = p->next) {
+			if (p->type == FDT_FIXUP_SETPROP &&
+			    p->nameoff >= strs_size && !strcmp(p->name, e->name))
+				e->nameoff = p->nameoff;
+		}
+		if (e->nameoff < 0) {
+			e->nameoff = size;
+			size += strlen(e->name) + 1;
+		}
+
+		prev = e->name;
+		prevoff = e->nameoff;
+	}
+
+	return size;
+}
+
+static char *fdt_fixup_emit_prop(char *out, int nameoff,
+				 const void *val, int len)
+{
+	fdt32_st(out, FDT_PROP);
+	fdt32_st(out + FDT_TAGSIZE, len);
+	fdt32_st(out + 2 * FDT_TAGSIZE, nameoff);
+	out += sizeof(struct fdt_property);
+	if (len)
+		memcpy(out, val, len);
+	memset(out + len, 0, FDT_FIXUP_ALIGN(len) - len);
+
+	return out + FDT_FIXUP_ALIGN(len);
+}
+
+static char *fdt_fixup_emit_new_node(char *out, struct fdt_fixup_edit *edits,
+				     const struct fdt_fixup_edit *add)
+{
+	int len = strlen(add->name) + 1;
+	struct fdt_fixup_edit *e, *group;
+
+	group = fdt_fixup_group(&edits, add->len);
+	for (e = group; e && e->node == add->len; e = e->next) {
+		if (e->type == FDT_FIXUP_DEL_NODE)
+			return out;
+	}
+
+	fdt32_st(out, FDT_BEGIN_NODE);
+	memcpy(out + FDT_TAGSIZE, add->name, len);
+	memset(out + FDT_TAGSIZE + len, 0, FDT_FIXUP_ALIGN(len) - len);
+	out += FDT_TAGSIZE + FDT_FIXUP_ALIGN(len);
+
+	/* Like libfdt, the latest property and sub-node come first */
+	for (e = group; e && e->node == add->len; e = e->next) {
+		if (e->type == FDT_FIXUP_SETPROP)
+			out = fdt_fixup_emit_prop(out, e->nameoff,
+						  e->data, e->len);
+	}
+	for (e = group; e && e->node == add->len; e = e->next) {
+		if (e->type == FDT_FIXUP_ADD_NODE)
+			out = fdt_fixup_emit_new_node(out, edits, e);
+	}
+
+	fdt32_st(out, FDT_END_NODE);
+
+	return out + FDT_TAGSIZE;
+}
+
+static bool fdt_fixup_has_prop(const char *props, const char *strs,
+			       int strs_size, const char *name)
+{
+	u32 tag, nameoff;
+	int len;
+
+	for (;;) {
+		tag = fdt32_ld((const fdt32_t *)props);
+		if (tag == FDT_NOP) {
+			props += FDT_TAGSIZE;
+			continue;
+		}
+		if (tag != FDT_PROP)
+			return false;
+
+		len = fdt32_ld((const fdt32_t *)(props + FDT_TAGSIZE));
+		nameoff = fdt32_ld((const fdt32_t *)(props + 2 * FDT_TAGSIZE));
+		if (nameoff < strs_size && !strcmp(strs + nameoff, name))
+			return true;
+		props += sizeof(struct fdt_property) + FDT_FIXUP_ALIGN(len);
+	}
+}
+
+/* Emit the new sub-nodes of a node before its first existing sub-node */
+static char *fdt_fixup_emit_subnodes(char *out, struct fdt_fixup_edit *edits,
+				     struct fdt_fixup_edit **group)
+{
+	struct fdt_fixup_edit *e, *g = *group;
+
+	*group = NULL;
+	for (e = g; e && e->node == g->node; e = e->next) {
+		if (e->type == FDT_FIXUP_ADD_NODE)
+			out = fdt_fixup_emit_new_node(out, edits, e);
+	}
+
+	return out;
+}
+
+/*
+ * Emit the structure block from src to out in one pass. The caller places
+ * src far enough after out so that out never overtakes the source data not
+ * consumed yet.
+ */
+static char *fdt_fixup_emit(char *out, const char *src, const char *strs,
+			    int strs_size, struct fdt_fixup_edit *edits)
+{
+	struct fdt_fixup_edit *stack[FDT_FIXUP_MAX_DEPTH];
+	struct fdt_fixup_edit *e, *group, *cursor = edits, *new_nodes;
+	int pos = 0, next, len, depth = 0, skip = 0;
+	u32 tag, nameoff;
+
+	for (new_nodes = edits; new_nodes; new_nodes = new_nodes->next) {
+		if (new_nodes->node & FDT_FIXUP_NEW_NODE)
+			break;
+	}
+
+	do {
+		tag = fdt32_ld((const fdt32_t *)(src + pos));
+		next = pos + FDT_TAGSIZE;
+		switch (tag) {
+		case FDT_BEGIN_NODE:
+			len = strlen(src + pos + FDT_TAGSIZE) + 1;
+			next += FDT_FIXUP_ALIGN(len);
+			if (skip) {
+				skip++;
+				break;
+			}
+			if (depth)
+				out = fdt_fixup_emit_subnodes(out, new_nodes,
+							      &stack[depth - 1]);
+
+			group = fdt_fixup_group(&cursor, pos);
+			for (e = group; e && e->node == pos; e = e->next) {
+				if (e->type == FDT_FIXUP_DEL_NODE)
+					break;
+			}
+			if (e && e->node == pos) {
+				skip = 1;
+				break;
+			}
+
+			memmove(out, src + pos, next - pos);
+			out += next - pos;
+			stack[depth++] = group;
+
+			/* Like libfdt, new properties come first, latest first */
+			for (e = group; e && e->node == pos; e = e->next) {
+				if (e->type != FDT_FIXUP_SETPROP ||
+				    fdt_fixup_has_prop(src + next, strs,
+						       strs_size, e->name))
+					continue;
+				out = fdt_fixup_emit_prop(out, e->nameoff,
+							  e->data, e->len);
+			}
+			break;
+		case FDT_PROP:
+			len = fdt32_ld((const fdt32_t *)(src + next));
+			nameoff = fdt32_ld((const fdt32_t *)(src + next +
+							    FDT_TAGSIZE));
+			next = pos + sizeof(struct fdt_property) +
+			       FDT_FIXUP_ALIGN(len);
+			if (skip)
+				break;
+
+			group = stack[depth - 1];
+			e = (group && nameoff < strs_size) ?
+			    fdt_fixup_find_prop(group, strs + nameoff) : NULL;
+			if (!e) {
+				memmove(out, src + pos, next - pos);
+				out += next - pos;
+			} else if (e->type == FDT_FIXUP_SETPROP) {
+				out = fdt_fixup_emit_prop(out, e->nameoff,
+							  e->data, e->len);
+			}
+			break;
+		case FDT_END_NODE:
+			if (skip) {
+				skip--;
+				break;
+			}
+			out = fdt_fixup_emit_subnodes(out, new_nodes,
+						      &stack[--depth]);
+			fdt32_st(out, FDT_END_NODE);
+			out += FDT_TAGSIZE;
+			break;
+		case FDT_END:
+			fdt32_st(out, FDT_END);
+			out += FDT_TAGSIZE;
+			break;
+		default:
+			/* Drop FDT_NOP */
+			break;
+		}
+		pos = next;
+	} while (tag != FDT_END);
+
+	return out;
+}
+
+static int fdt_fixup_commit(void *fdt)
+{
+	unsigned long bufsize, struct_off, blocks_size, shift;
+	int rc, off, next, depth, strs_size, new_strs_size;
+	struct fdt_fixup_edit *edits, *e;
+	char *out, *src, *strs;
+
+	if (!fixup.edits)
+		return 0;
+
+	fdt_index_invalidate();
+	bufsize = fdt_totalsize(fdt) + BIT_ALIGN(fixup.grow, 8);
+	rc = fdt_open_into(fdt, fdt, bufsize);
+	if (rc < 0)
+		return rc;
+
+	/* The structure block is emitted without checks so validate it */
+	for (off = 0, depth = 0; off >= 0 && depth >= 0;
+	     off = fdt_next_node(fdt, off, &depth)) {
+		if (FDT_FIXUP_MAX_DEPTH <= depth)
+			return SBI_ENOSPC;
+	}
+	if (off < 0 || fdt_next_tag(fdt, off, &next) != FDT_END)
+		return SBI_EINVAL;
+
+	/*
+	 * Move the structure and strings blocks to the end of the buffer
+	 * and emit the fixed structure block in their place.
+	 */
+	struct_off = fdt_off_dt_struct(fdt);
+	strs_size = fdt_size_dt_strings(fdt);
+	blocks_size = fdt_off_dt_strings(fdt) + strs_size - struct_off;
+	shift = (bufsize - struct_off - blocks_size) &
+		~(unsigned long)(FDT_TAGSIZE - 1);
+	out = (char *)fdt + struct_off;
+	src = out + shift;
+	memmove(src, out, blocks_size);
+	strs = src + fdt_size_dt_struct(fdt);
+
+	edits = fdt_fixup_sort(fixup.edits);
+	fixup.edits = NULL;
+	new_strs_size = fdt_fixup_resolve(edits, strs, strs_size);
+	out = fdt_fixup_emit(out, src, strs, strs_size, edits);
+
+	memmove(out, strs, strs_size);
+	for (e = edits; e; e = e->next) {
+		if (e->type == FDT_FIXUP_SETPROP && e->nameoff >= strs_size)
+			memcpy(out + e->nameoff, e->name, strlen(e->name) + 1);
+	}
+
+	fdt_set_size_dt_struct(fdt, out - ((char *)fdt + struct_off));
+	fdt_set_off_dt_strings(fdt, out - (char *)fdt);
+	fdt_set_size_dt_strings(fdt, new_strs_size);
+
+	return 0;
+}
+
+int fdt_fixup_end(void *fdt)
+{
+	struct fdt_fixup_chunk *chunk;
+	int rc;
+
+	if (!fixup.depth || fdt != fixup.fdt)
+		return SBI_EINVAL;
+	if (--fixup.depth)
+		return 0;
+
+	/* Never apply a batch partially */
+	rc = fixup.error;
+	if (!rc)
+		rc = fdt_fixup_commit(fdt);
+	if (rc)
+		sbi_printf("%s: failed to apply DT fixups (error %d)\n",
+			   __func__, rc);
+
+	while ((chunk = fixup.chunks)) {
+		fixup.chunks = chunk->next;
+		sbi_free(chunk);
+	}
+	fixup.edits = NULL;
+	fixup.fdt = NULL;
+
+	return rc;
+}
 
 int fdt_add_cpu_idle_states(void *fdt, const struct sbi_cpu_idle_state *state)
 {
 	int cpu_node, cpus_node, err, idle_states_node;
 	uint32_t count, phandle;
 
+	fdt_index_invalidate();
 	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 1024);
 	if (err < 0)
 		return err;
@@ -112,14 +762,13 @@ void fdt_cpu_fixup(void *fdt)
 	const char *mmu_type;
 	u32 hartid;
 
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 32);
-	if (err < 0)
-		return;
-
 	cpus_offset = fdt_path_offset(fdt, "/cpus");
 	if (cpus_offset < 0)
 		return;
 
+	if (fdt_fixup_begin(fdt))
+		return;
+
 	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
 		err = fdt_parse_hart_id(fdt, cpu_offset, &hartid);
 		if (err)
@@ -137,9 +786,11 @@ void fdt_cpu_fixup(void *fdt)
 		mmu_type = fdt_getprop(fdt, cpu_offset, "mmu-type", &len);
 		if (!sbi_domain_is_assigned_hart(dom, hartid) ||
 		    !mmu_type || !len)
-			fdt_setprop_string(fdt, cpu_offset, "status",
-					   "disabled");
+			fdt_fixup_setprop_string(fdt, cpu_offset, "status",
+						 "disabled");
 	}
+
+	fdt_fixup_end(fdt);
 }
 
 static void fdt_domain_based_fixup_one(void *fdt, int nodeoff)
@@ -153,21 +804,22 @@ static void fdt_domain_based_fixup_one(void *fdt, int nodeoff)
 		return;
 
 	if (!sbi_domain_check_addr(dom, reg_addr, dom->next_mode,
-				    SBI_DOMAIN_READ | SBI_DOMAIN_WRITE)) {
-		rc = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 32);
-		if (rc < 0)
-			return;
-		fdt_setprop_string(fdt, nodeoff, "status", "disabled");
-	}
+				    SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		fdt_fixup_setprop_string(fdt, nodeoff, "status", "disabled");
 }
 
 static void fdt_fixup_node(void *fdt, const char *compatible)
 {
 	int noff = 0;
 
-	while ((noff = fdt_node_offset_by_compatible(fdt, noff,
-						     compatible)) >= 0)
+	if (fdt_fixup_begin(fdt))
+		return;
+
+	while ((noff = fdt_index_node_offset_by_compatible(fdt, noff,
+							   compatible)) >= 0)
 		fdt_domain_based_fixup_one(fdt, noff);
+
+	fdt_fixup_end(fdt);
 }
 
 void fdt_aplic_fixup(void *fdt)
@@ -186,9 +838,11 @@ void fdt_plic_fixup(void *fdt)
 	int i, cells_count;
 	int plic_off;
 
-	plic_off = fdt_node_offset_by_compatible(fdt, 0, "sifive,plic-1.0.0");
+	plic_off = fdt_index_node_offset_by_compatible(fdt, 0,
+						       "sifive,plic-1.0.0");
 	if (plic_off < 0) {
-		plic_off = fdt_node_offset_by_compatible(fdt, 0, "riscv,plic0");
+		plic_off = fdt_index_node_offset_by_compatible(fdt, 0,
+							       "riscv,plic0");
 		if (plic_off < 0)
 			return;
 	}
@@ -235,7 +889,7 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 			     "mmode_resv%d@%x", index,
 			     addr_low);
 
-	subnode = fdt_add_subnode(fdt, parent, name);
+	subnode = fdt_fixup_add_subnode(fdt, parent, name);
 	if (subnode < 0)
 		return subnode;
 
@@ -244,7 +898,7 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 	 * mapping of the region as part of its standard
 	 * mapping of system memory.
 	 */
-	err = fdt_setprop_empty(fdt, subnode, "no-map");
+	err = fdt_fixup_setprop_empty(fdt, subnode, "no-map");
 	if (err < 0)
 		return err;
 
@@ -257,8 +911,8 @@ static int fdt_resv_memory_update_node(void *fdt, unsigned long addr,
 		*val++ = cpu_to_fdt32(size_high);
 	*val++ = cpu_to_fdt32(size_low);
 
-	err = fdt_setprop(fdt, subnode, "reg", reg,
-			  (na + ns) * sizeof(fdt32_t));
+	err = fdt_fixup_setprop(fdt, subnode, "reg", reg,
+				(na + ns) * sizeof(fdt32_t));
 	if (err < 0)
 		return err;
 
@@ -287,28 +941,23 @@ int fdt_reserved_memory_fixup(void *fdt)
 	unsigned long filtered_base[PMP_COUNT] = { 0 };
 	unsigned char filtered_order[PMP_COUNT] = { 0 };
 	unsigned long addr, size;
-	int err, parent, i, j;
+	int err, rc, parent, i, j;
 	int na = fdt_address_cells(fdt, 0);
 	int ns = fdt_size_cells(fdt, 0);
 
-	/*
-	 * Expand the device tree to accommodate new node
-	 * by the following estimated size:
-	 *
-	 * Each PMP memory region entry occupies 64 bytes.
-	 * With 16 PMP memory regions we need 64 * 16 = 1024 bytes.
-	 */
-	err = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + 1024);
-	if (err < 0)
+	err = fdt_fixup_begin(fdt);
+	if (err)
 		return err;
 
 	/* try to locate the reserved memory node */
 	parent = fdt_path_offset(fdt, "/reserved-memory");
 	if (parent < 0) {
 		/* if such node does not exist, create one */
-		parent = fdt_add_subnode(fdt, 0, "reserved-memory");
-		if (parent < 0)
-			return parent;
+		parent = fdt_fixup_add_subnode(fdt, 0, "reserved-memory");
+		if (parent < 0) {
+			err = parent;
+			goto done;
+		}
 
 		/*
 		 * reserved-memory node has 3 required properties:
@@ -317,17 +966,17 @@ int fdt_reserved_memory_fixup(void *fdt)
 		 * - ranges: should be empty
 		 */
 
-		err = fdt_setprop_empty(fdt, parent, "ranges");
+		err = fdt_fixup_setprop_empty(fdt, parent, "ranges");
 		if (err < 0)
-			return err;
+			goto done;
 
-		err = fdt_setprop_u32(fdt, parent, "#size-cells", ns);
+		err = fdt_fixup_setprop_u32(fdt, parent, "#size-cells", ns);
 		if (err < 0)
-			return err;
+			goto done;
 
-		err = fdt_setprop_u32(fdt, parent, "#address-cells", na);
+		err = fdt_fixup_setprop_u32(fdt, parent, "#address-cells", na);
 		if (err < 0)
-			return err;
+			goto done;
 	}
 
 	/*
@@ -355,7 +1004,8 @@ int fdt_reserved_memory_fixup(void *fdt)
 		if (i >= PMP_COUNT) {
 			sbi_printf("%s: Too many memory regions to fixup.\n",
 				   __func__);
-			return SBI_ENOSPC;
+			err = SBI_ENOSPC;
+			goto done;
 		}
 
 		bool overlap = false;
@@ -382,7 +1032,11 @@ int fdt_reserved_memory_fixup(void *fdt)
 		fdt_resv_memory_update_node(fdt, addr, size, j, parent);
 	}
 
-	return 0;
+	err = 0;
+done:
+	rc = fdt_fixup_end(fdt);
+
+	return err ? err : rc;
 }
 
 void fdt_config_fixup(void *fdt)
@@ -393,15 +1047,22 @@ void fdt_config_fixup(void *fdt)
 	if (chosen_offset < 0)
 		return;
 
-	config_offset = fdt_node_offset_by_compatible(fdt, chosen_offset, "opensbi,config");
-	if (chosen_offset < 0)
+	config_offset = fdt_index_node_offset_by_compatible(fdt, chosen_offset,
+							    "opensbi,config");
+	if (config_offset < 0)
 		return;
 
-	fdt_nop_node(fdt, config_offset);
+	if (fdt_fixup_begin(fdt))
+		return;
+	fdt_fixup_del_node(fdt, config_offset);
+	fdt_fixup_end(fdt);
 }
 
 void fdt_fixups(void *fdt)
 {
+	if (fdt_fixup_begin(fdt))
+		return;
+
 	fdt_aplic_fixup(fdt);
 
 	fdt_imsic_fixup(fdt);
@@ -415,4 +1076,6 @@ void fdt_fixups(void *fdt)
 #endif
 
 	fdt_config_fixup(fdt);
+
+	fdt_fixup_end(fdt);
 }
@@ -14,6 +14,7 @@
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_hart.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
 #include <sbi_utils/irqchip/aplic.h>
 #include <sbi_utils/irqchip/imsic.h>
 #include <sbi_utils/irqchip/plic.h>
@@ -62,7 +63,7 @@ int fdt_find_match(void *fdt, int startoff,
 		return SBI_ENODEV;
 
 	while (match_table->compatible) {
-		nodeoff = fdt_node_offset_by_compatible(fdt, startoff,
+		nodeoff = fdt_index_node_offset_by_compatible(fdt, startoff,
 						match_table->compatible);
 		if (nodeoff >= 0) {
 			if (out_match)
@@ -92,7 +93,7 @@ int fdt_parse_phandle_with_args(void *fdt, int nodeoff,
 	list_end = list + (len / sizeof(*list));
 
 	while (list < list_end) {
-		pnodeoff = fdt_node_offset_by_phandle(fdt,
+		pnodeoff = fdt_index_node_offset_by_phandle(fdt,
 						fdt32_to_cpu(*list));
 		if (pnodeoff < 0)
 			return pnodeoff;
@@ -265,10 +266,15 @@ int fdt_parse_hart_id(void *fdt, int cpu_offset, u32 *hartid)
 	int len;
 	const void *prop;
 	const fdt32_t *val;
+	int rc;
 
 	if (!fdt || cpu_offset < 0)
 		return SBI_EINVAL;
 
+	rc = fdt_index_hart_id(fdt, cpu_offset, hartid);
+	if (rc != SBI_ENOSYS)
+		return rc;
+
 	prop = fdt_getprop(fdt, cpu_offset, "device_type", &len);
 	if (!prop || !len)
 		return SBI_EINVAL;
@@ -593,7 +599,7 @@ int fdt_parse_uart8250(void *fdt, struct platform_uart_data *uart,
 	if (!compatible || !uart || !fdt)
 		return SBI_ENODEV;
 
-	nodeoffset = fdt_node_offset_by_compatible(fdt, -1, compatible);
+	nodeoffset = fdt_index_node_offset_by_compatible(fdt, -1, compatible);
 	if (nodeoffset < 0)
 		return nodeoffset;
 
@@ -645,7 +651,7 @@ int fdt_parse_aplic_node(void *fdt, int nodeoff, struct aplic_data *aplic)
 
 	val = fdt_getprop(fdt, nodeoff, "msi-parent", &len);
 	if (val && len >= sizeof(fdt32_t)) {
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_index_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -678,7 +684,7 @@ int fdt_parse_aplic_node(void *fdt, int nodeoff, struct aplic_data *aplic)
 		if (!val || len < sizeof(fdt32_t))
 			goto aplic_msi_parent_done;
 
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_index_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -686,7 +692,7 @@ int fdt_parse_aplic_node(void *fdt, int nodeoff, struct aplic_data *aplic)
 		if (!val || len < sizeof(fdt32_t))
 			goto aplic_msi_parent_done;
 
-		noff = fdt_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
+		noff = fdt_index_node_offset_by_phandle(fdt, fdt32_to_cpu(*val));
 		if (noff < 0)
 			return noff;
 
@@ -772,7 +778,7 @@ bool fdt_check_imsic_mlevel(void *fdt)
 	if (!fdt)
 		return false;
 
-	while ((noff = fdt_node_offset_by_compatible(fdt, noff,
+	while ((noff = fdt_index_node_offset_by_compatible(fdt, noff,
 						     "riscv,imsics")) >= 0) {
 		val = fdt_getprop(fdt, noff, "interrupts-extended", &len);
 		if (val && len > sizeof(fdt32_t)) {
@@ -896,7 +902,7 @@ int fdt_parse_plic(void *fdt, struct plic_data *plic, const char *compat)
 	if (!compat || !plic || !fdt)
 		return SBI_ENODEV;
 
-	nodeoffset = fdt_node_offset_by_compatible(fdt, -1, compat);
+	nodeoffset = fdt_index_node_offset_by_compatible(fdt, -1, compat);
 	if (nodeoffset < 0)
 		return nodeoffset;
 
@@ -999,11 +1005,11 @@ int fdt_parse_aclint_node(void *fdt, int nodeoffset,
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[(2 * i) + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
+		cpu_intc_offset = fdt_index_node_offset_by_phandle(fdt, phandle);
 		if (cpu_intc_offset < 0)
 			continue;
 
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
+		cpu_offset = fdt_index_parent_offset(fdt, cpu_intc_offset);
 		if (cpu_offset < 0)
 			continue;
 
@@ -1063,11 +1069,11 @@ int fdt_parse_plmt_node(void *fdt, int nodeoffset, unsigned long *plmt_base,
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[2 * i + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
+		cpu_intc_offset = fdt_index_node_offset_by_phandle(fdt, phandle);
 		if (cpu_intc_offset < 0)
 			continue;
 
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
+		cpu_offset = fdt_index_parent_offset(fdt, cpu_intc_offset);
 		if (cpu_offset < 0)
 			continue;
 
@@ -1119,11 +1125,11 @@ int fdt_parse_plicsw_node(void *fdt, int nodeoffset, unsigned long *plicsw_base,
 		phandle = fdt32_to_cpu(val[2 * i]);
 		hwirq = fdt32_to_cpu(val[2 * i + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
+		cpu_intc_offset = fdt_index_node_offset_by_phandle(fdt, phandle);
 		if (cpu_intc_offset < 0)
 			continue;
 
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
+		cpu_offset = fdt_index_parent_offset(fdt, cpu_intc_offset);
 		if (cpu_offset < 0)
 			continue;
 
@@ -1149,7 +1155,7 @@ int fdt_parse_compat_addr(void *fdt, uint64_t *addr,
 {
 	int nodeoffset, rc;
 
-	nodeoffset = fdt_node_offset_by_compatible(fdt, -1, compatible);
+	nodeoffset = fdt_index_node_offset_by_compatible(fdt, -1, compatible);
 	if (nodeoffset < 0)
 		return nodeoffset;
 
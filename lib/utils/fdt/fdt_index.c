@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * fdt_index.c - Lookup index of the Flat Device Tree
+ *
+ * Copyright (c) 2024 Andes Technology Corporation
+ */
+
+#include <libfdt.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_string.h>
+#include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
+
+/* Maximum depth of nodes in an indexed FDT */
+#define FDT_INDEX_MAX_DEPTH	32
+
+/* Heap overhead of one table of the index */
+#define FDT_INDEX_ALLOC_SLACK	64
+
+struct fdt_index_node {
+	int offset;
+	int parent;
+};
+
+struct fdt_index_compat {
+	/* Compatible string in the FDT (NULL for a free bucket) */
+	const char *compat;
+	int len;
+	/* Nodes of this compatible in index_compat_nodes */
+	u32 start;
+	u32 count;
+	/* Last node added, for compatible lists naming a string twice */
+	int last;
+};
+
+struct fdt_index_phandle {
+	u32 phandle;
+	int offset;
+};
+
+struct fdt_index_cpu {
+	int offset;
+	u32 hartid;
+};
+
+/* Indexed FDT (NULL if the index is not valid) */
+static const void *index_fdt;
+
+/* All nodes sorted by offset */
+static struct fdt_index_node *index_nodes;
+static u32 index_node_count;
+
+/* Hash of compatible strings and their nodes sorted by offset */
+static struct fdt_index_compat *index_compats;
+static u32 index_compat_mask;
+static u32 index_compat_used;
+static int *index_compat_nodes;
+
+/* Hash of phandles */
+static struct fdt_index_phandle *index_phandles;
+static u32 index_phandle_mask;
+
+/* Cpu nodes sorted by offset */
+static struct fdt_index_cpu *index_cpus;
+static u32 index_cpu_count;
+
+/* Number of entries of a FDT in each table of the index */
+struct fdt_index_counts {
+	u32 nodes;
+	/* Compatible strings of all nodes, including duplicates */
+	u32 compats;
+	u32 phandles;
+	u32 cpus;
+};
+
+/* Initial size of the compatible hash, grown with the unique strings */
+#define FDT_INDEX_COMPAT_HASH_MIN	16
+
+static u32 index_hash_size(u32 count)
+{
+	u32 size = 16;
+
+	/* Keep the hash tables at most half full */
+	while (size < 2 * count)
+		size <<= 1;
+
+	return size;
+}
+
+static u32 index_hash_string(const char *str, int len)
+{
+	u32 hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (u8)str[i]) * 16777619U;
+
+	return hash;
+}
+
+/* Bucket of a compatible string, or the free bucket to insert it */
+static struct fdt_index_compat *index_compat_slot(const char *compat, int len)
+{
+	struct fdt_index_compat *c;
+	u32 i = index_hash_string(compat, len) & index_compat_mask;
+
+	for (;; i = (i + 1) & index_compat_mask) {
+		c = &index_compats[i];
+		if (!c->compat)
+			return c;
+		if (c->len == len && !memcmp(c->compat, compat, len))
+			return c;
+	}
+}
+
+static int index_compat_grow(void)
+{
+	struct fdt_index_compat *old = index_compats;
+	u32 i, old_mask = index_compat_mask;
+
+	index_compats = sbi_calloc(sizeof(*index_compats),
+				   2 * (old_mask + 1));
+	if (!index_compats) {
+		index_compats = old;
+		return SBI_ENOMEM;
+	}
+	index_compat_mask = 2 * old_mask + 1;
+
+	for (i = 0; i <= old_mask; i++) {
+		if (old[i].compat)
+			*index_compat_slot(old[i].compat, old[i].len) = old[i];
+	}
+	sbi_free(old);
+
+	return 0;
+}
+
+static struct fdt_index_compat *index_compat_find(const char *compat, int len,
+						  bool insert)
+{
+	struct fdt_index_compat *c = index_compat_slot(compat, len);
+
+	if (c->compat)
+		return c;
+	if (!insert)
+		return NULL;
+
+	/* Size the hash by unique strings, keeping it at most half full */
+	if (2 * (index_compat_used + 1) > index_compat_mask + 1) {
+		if (index_compat_grow())
+			return NULL;
+		c = index_compat_slot(compat, len);
+	}
+
+	c->compat = compat;
+	c->len = len;
+	c->last = -1;
+	index_compat_used++;
+	return c;
+}
+
+static struct fdt_index_phandle *index_phandle_find(u32 phandle, bool insert)
+{
+	struct fdt_index_phandle *p;
+	u32 i = (phandle * 2654435761U) & index_phandle_mask;
+
+	for (;; i = (i + 1) & index_phandle_mask) {
+		p = &index_phandles[i];
+		if (!p->phandle)
+			break;
+		if (p->phandle == phandle)
+			return p;
+	}
+
+	return insert ? p : NULL;
+}
+
+/* Iterate over the strings of the compatible property of a node */
+#define index_for_each_compat(__fdt, __off, __s, __len, __end)		\
+	for (__s = fdt_getprop((__fdt), (__off), "compatible", &(__len)),	\
+	     __end = (__s) ? (__s) + (__len) : NULL;			\
+	     (__s) && (__s) < (__end) &&				\
+	     ((__len) = strnlen((__s), (__end) - (__s))) < (__end) - (__s); \
+	     (__s) += (__len) + 1)
+
+static void index_free(void)
+{
+	sbi_free(index_nodes);
+	sbi_free(index_compats);
+	sbi_free(index_compat_nodes);
+	sbi_free(index_phandles);
+	sbi_free(index_cpus);
+	index_nodes = NULL;
+	index_compats = NULL;
+	index_compat_nodes = NULL;
+	index_phandles = NULL;
+	index_cpus = NULL;
+	index_node_count = index_cpu_count = index_compat_used = 0;
+}
+
+static int index_count(const void *fdt, struct fdt_index_counts *cnt)
+{
+	int off, depth, len;
+	const char *s, *end;
+	u32 phandle, hartid;
+
+	sbi_memset(cnt, 0, sizeof(*cnt));
+	for (off = 0, depth = 0; off >= 0 && depth >= 0;
+	     off = fdt_next_node(fdt, off, &depth)) {
+		if (FDT_INDEX_MAX_DEPTH <= depth)
+			return SBI_ENOSPC;
+
+		cnt->nodes++;
+		index_for_each_compat(fdt, off, s, len, end)
+			cnt->compats++;
+
+		phandle = fdt_get_phandle(fdt, off);
+		if (phandle && phandle != (u32)-1)
+			cnt->phandles++;
+
+		if (!fdt_parse_hart_id((void *)fdt, off, &hartid))
+			cnt->cpus++;
+	}
+
+	if (off < 0 && off != -FDT_ERR_NOTFOUND)
+		return SBI_EINVAL;
+
+	return 0;
+}
+
+/* Fill the nodes, phandles, cpus and count nodes of compatibles */
+static int index_fill(const void *fdt)
+{
+	int off, depth, len, parents[FDT_INDEX_MAX_DEPTH];
+	struct fdt_index_compat *c;
+	struct fdt_index_phandle *p;
+	const char *s, *end;
+	u32 phandle, hartid;
+
+	for (off = 0, depth = 0; off >= 0 && depth >= 0;
+	     off = fdt_next_node(fdt, off, &depth)) {
+		parents[depth] = off;
+
+		index_nodes[index_node_count].offset = off;
+		index_nodes[index_node_count].parent =
+			depth ? parents[depth - 1] : -FDT_ERR_NOTFOUND;
+		index_node_count++;
+
+		index_for_each_compat(fdt, off, s, len, end) {
+			c = index_compat_find(s, len, true);
+			if (!c)
+				return SBI_ENOMEM;
+			if (c->last != off)
+				c->count++;
+			c->last = off;
+		}
+
+		phandle = fdt_get_phandle(fdt, off);
+		if (phandle && phandle != (u32)-1) {
+			p = index_phandle_find(phandle, true);
+			/* Keep the first node like fdt_node_offset_by_phandle() */
+			if (!p->phandle) {
+				p->phandle = phandle;
+				p->offset = off;
+			}
+		}
+
+		if (!fdt_parse_hart_id((void *)fdt, off, &hartid)) {
+			index_cpus[index_cpu_count].offset = off;
+			index_cpus[index_cpu_count].hartid = hartid;
+			index_cpu_count++;
+		}
+	}
+
+	return 0;
+}
+
+unsigned long fdt_index_heap_size(const void *fdt)
+{
+	struct fdt_index_counts cnt;
+	unsigned long size;
+
+	if (!fdt || index_count(fdt, &cnt))
+		return 0;
+
+	size = cnt.nodes * sizeof(*index_nodes);
+	size += cnt.compats * sizeof(*index_compat_nodes);
+	/* All strings may be unique, and the old hash is live while growing */
+	size += 2 * index_hash_size(cnt.compats) * sizeof(*index_compats);
+	size += index_hash_size(cnt.phandles) * sizeof(*index_phandles);
+	size += cnt.cpus * sizeof(*index_cpus);
+
+	/* Allocator overhead of the tables */
+	return size + 6 * FDT_INDEX_ALLOC_SLACK;
+}
+
+int fdt_index_build(const void *fdt)
+{
+	struct fdt_index_counts cnt;
+	struct fdt_index_compat *c;
+	u32 i, start = 0;
+	const char *s, *end;
+	int rc, len;
+
+	fdt_index_invalidate();
+	if (!fdt)
+		return SBI_EINVAL;
+
+	rc = index_count(fdt, &cnt);
+	if (rc)
+		return rc;
+
+	index_nodes = sbi_calloc(sizeof(*index_nodes), cnt.nodes);
+	index_compat_nodes = sbi_calloc(sizeof(*index_compat_nodes),
+					cnt.compats ? cnt.compats : 1);
+	index_compat_mask = FDT_INDEX_COMPAT_HASH_MIN - 1;
+	index_compats = sbi_calloc(sizeof(*index_compats),
+				   index_compat_mask + 1);
+	index_phandle_mask = index_hash_size(cnt.phandles) - 1;
+	index_phandles = sbi_calloc(sizeof(*index_phandles),
+				    index_phandle_mask + 1);
+	index_cpus = sbi_calloc(sizeof(*index_cpus),
+				cnt.cpus ? cnt.cpus : 1);
+	if (!index_nodes || !index_compat_nodes || !index_compats ||
+	    !index_phandles || !index_cpus) {
+		index_free();
+		return SBI_ENOMEM;
+	}
+
+	rc = index_fill(fdt);
+	if (rc) {
+		index_free();
+		return rc;
+	}
+
+	for (i = 0; i <= index_compat_mask; i++) {
+		c = &index_compats[i];
+		if (!c->compat)
+			continue;
+		c->start = start;
+		start += c->count;
+		c->count = 0;
+		c->last = -1;
+	}
+
+	/* Nodes are visited in offset order so each list ends up sorted */
+	for (i = 0; i < index_node_count; i++) {
+		index_for_each_compat(fdt, index_nodes[i].offset, s, len, end) {
+			c = index_compat_find(s, len, false);
+			if (c->last == index_nodes[i].offset)
+				continue;
+			c->last = index_nodes[i].offset;
+			index_compat_nodes[c->start + c->count++] = c->last;
+		}
+	}
+
+	index_fdt = fdt;
+
+	return 0;
+}
+
+void fdt_index_invalidate(void)
+{
+	if (!index_nodes)
+		return;
+
+	index_fdt = NULL;
+	index_free();
+}
+
+int fdt_index_node_offset_by_compatible(const void *fdt, int startoffset,
+					const char *compatible)
+{
+	const struct fdt_index_compat *c;
+	u32 lo, hi, mid;
+	const int *nodes;
+
+	if (!fdt || fdt != index_fdt || !compatible)
+		return fdt_node_offset_by_compatible(fdt, startoffset,
+						     compatible);
+
+	c = index_compat_find(compatible, strlen(compatible), false);
+	if (!c)
+		return -FDT_ERR_NOTFOUND;
+
+	/* First node of the compatible after startoffset */
+	nodes = &index_compat_nodes[c->start];
+	lo = 0;
+	hi = c->count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (nodes[mid] <= startoffset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return (lo < c->count) ? nodes[lo] : -FDT_ERR_NOTFOUND;
+}
+
+int fdt_index_node_offset_by_phandle(const void *fdt, uint32_t phandle)
+{
+	const struct fdt_index_phandle *p;
+
+	if (!fdt || fdt != index_fdt)
+		return fdt_node_offset_by_phandle(fdt, phandle);
+
+	if (!phandle || phandle == (u32)-1)
+		return -FDT_ERR_BADPHANDLE;
+
+	p = index_phandle_find(phandle, false);
+
+	return (p) ? p->offset : -FDT_ERR_NOTFOUND;
+}
+
+static const struct fdt_index_node *index_node_find(int offset)
+{
+	u32 lo = 0, hi = index_node_count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (index_nodes[mid].offset == offset)
+			return &index_nodes[mid];
+		if (index_nodes[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+int fdt_index_parent_offset(const void *fdt, int nodeoffset)
+{
+	const struct fdt_index_node *node;
+
+	if (!fdt || fdt != index_fdt)
+		return fdt_parent_offset(fdt, nodeoffset);
+
+	node = index_node_find(nodeoffset);
+	if (!node)
+		return fdt_parent_offset(fdt, nodeoffset);
+
+	return node->parent;
+}
+
+int fdt_index_hart_id(const void *fdt, int cpu_offset, u32 *hartid)
+{
+	u32 lo = 0, hi, mid;
+
+	if (!fdt || fdt != index_fdt)
+		return SBI_ENOSYS;
+
+	hi = index_cpu_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (index_cpus[mid].offset == cpu_offset) {
+			if (hartid)
+				*hartid = index_cpus[mid].hartid;
+			return 0;
+		}
+		if (index_cpus[mid].offset < cpu_offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return SBI_EINVAL;
+}
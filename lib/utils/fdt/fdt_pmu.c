@@ -13,11 +13,10 @@
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
+#include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/fdt/fdt_pmu.h>
 
-#define FDT_PMU_HW_EVENT_MAX (SBI_PMU_HW_EVENT_MAX * 2)
-
 struct fdt_pmu_hw_event_select_map fdt_pmu_evt_select[FDT_PMU_HW_EVENT_MAX] = {0};
 uint32_t hw_event_count;
 
@@ -47,13 +46,16 @@ int fdt_pmu_fixup(void *fdt)
 	if (pmu_offset < 0)
 		return SBI_EFAIL;
 
-	fdt_delprop(fdt, pmu_offset, "riscv,event-to-mhpmcounters");
-	fdt_delprop(fdt, pmu_offset, "riscv,event-to-mhpmevent");
-	fdt_delprop(fdt, pmu_offset, "riscv,raw-event-to-mhpmcounters");
+	if (fdt_fixup_begin(fdt))
+		return SBI_EINVAL;
+
+	fdt_fixup_delprop(fdt, pmu_offset, "riscv,event-to-mhpmcounters");
+	fdt_fixup_delprop(fdt, pmu_offset, "riscv,event-to-mhpmevent");
+	fdt_fixup_delprop(fdt, pmu_offset, "riscv,raw-event-to-mhpmcounters");
 	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_SSCOFPMF))
-		fdt_delprop(fdt, pmu_offset, "interrupts-extended");
+		fdt_fixup_delprop(fdt, pmu_offset, "interrupts-extended");
 
-	return 0;
+	return fdt_fixup_end(fdt);
 }
 
 int fdt_pmu_setup(void *fdt)
@@ -13,6 +13,7 @@
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_heap.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
 #include <sbi_utils/irqchip/fdt_irqchip.h>
 #include <sbi_utils/irqchip/imsic.h>
 
@@ -32,11 +33,11 @@ static int irqchip_imsic_update_hartid_table(void *fdt, int nodeoff,
 		phandle = fdt32_to_cpu(val[i]);
 		hwirq = fdt32_to_cpu(val[i + 1]);
 
-		cpu_intc_offset = fdt_node_offset_by_phandle(fdt, phandle);
+		cpu_intc_offset = fdt_index_node_offset_by_phandle(fdt, phandle);
 		if (cpu_intc_offset < 0)
 			continue;
 
-		cpu_offset = fdt_parent_offset(fdt, cpu_intc_offset);
+		cpu_offset = fdt_index_parent_offset(fdt, cpu_intc_offset);
 		if (cpu_offset < 0)
 			continue;
 
@@ -16,6 +16,7 @@
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi_utils/irqchip/imsic.h>
 
@@ -95,9 +96,31 @@ static unsigned long imsic_file_offset;
 #define imsic_set_hart_file(__scratch, __file)				\
 	sbi_scratch_write_type((__scratch), long, imsic_file_offset, (__file))
 
+/* M-level IPI doorbell of each HART indexed by hartindex (NULL if none) */
+static void *imsic_ipi_doorbell[SBI_HARTMASK_MAX_BITS];
+
+static void *imsic_hart_doorbell(struct imsic_data *imsic, int file)
+{
+	unsigned long reloff;
+	struct imsic_regs *regs;
+
+	regs = &imsic->regs[0];
+	reloff = file * (1UL << imsic->guest_index_bits) * IMSIC_MMIO_PAGE_SZ;
+	while (regs->size && (regs->size <= reloff)) {
+		reloff -= regs->size;
+		regs++;
+	}
+
+	if (!regs->size || (regs->size <= reloff))
+		return NULL;
+
+	return (void *)(regs->addr + reloff + IMSIC_MMIO_PAGE_LE);
+}
+
 int imsic_map_hartid_to_data(u32 hartid, struct imsic_data *imsic, int file)
 {
 	struct sbi_scratch *scratch;
+	u32 hart_index;
 
 	if (!imsic || !imsic->targets_mmode)
 		return SBI_EINVAL;
@@ -115,6 +138,12 @@ int imsic_map_hartid_to_data(u32 hartid, struct imsic_data *imsic, int file)
 
 	imsic_set_hart_data_ptr(scratch, imsic);
 	imsic_set_hart_file(scratch, file);
+
+	/* Resolve the doorbell once so that sending an IPI is one store */
+	hart_index = sbi_hartid_to_hartindex(hartid);
+	if (sbi_hartindex_valid(hart_index))
+		imsic_ipi_doorbell[hart_index] = imsic_hart_doorbell(imsic, file);
+
 	return 0;
 }
 
@@ -163,31 +192,10 @@ static int imsic_external_irqfn(struct sbi_trap_regs *regs)
 
 static void imsic_ipi_send(u32 hart_index)
 {
-	unsigned long reloff;
-	struct imsic_regs *regs;
-	struct imsic_data *data;
-	struct sbi_scratch *scratch;
-	int file;
-
-	scratch = sbi_hartindex_to_scratch(hart_index);
-	if (!scratch)
-		return;
-
-	data = imsic_get_hart_data_ptr(scratch);
-	file = imsic_get_hart_file(scratch);
-	if (!data || !data->targets_mmode)
-		return;
-
-	regs = &data->regs[0];
-	reloff = file * (1UL << data->guest_index_bits) * IMSIC_MMIO_PAGE_SZ;
-	while (regs->size && (regs->size <= reloff)) {
-		reloff -= regs->size;
-		regs++;
-	}
+	void *doorbell = imsic_ipi_doorbell[hart_index];
 
-	if (regs->size && (reloff < regs->size))
-		writel_relaxed(IMSIC_IPI_ID,
-			(void *)(regs->addr + reloff + IMSIC_MMIO_PAGE_LE));
+	if (doorbell)
+		writel_relaxed(IMSIC_IPI_ID, doorbell);
 }
 
 static struct sbi_ipi_device imsic_ipi_device = {
@@ -4,9 +4,13 @@
  * Copyright (c) 2024 Intel Corporation. All rights reserved.
  */
 
+#include <sbi/sbi_domain_context.h>
+#include <sbi/sbi_ecall.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_heap.h>
 #include <sbi/sbi_rpxy.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
 #include <libfdt.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/rpxy/fdt_rpxy.h>
@@ -39,6 +43,9 @@ struct abi_entry_vectors {
 
 struct abi_entry_vectors *entry_vector_table = NULL;
 
+/* Entry of direct fast calls, optionally registered with RETURN_INIT_DONE */
+static unsigned long direct_abi_entry;
+
 #define ABI_ENTRY_TYPE_FAST			1
 #define ABI_ENTRY_TYPE_YIELD		0
 #define FUNCID_TYPE_SHIFT			31
@@ -46,12 +53,59 @@ struct abi_entry_vectors *entry_vector_table = NULL;
 #define GET_ABI_ENTRY_TYPE(id)		(((id) >> FUNCID_TYPE_SHIFT) & \
 					 FUNCID_TYPE_MASK)
 
-static char spd_domain_name[64];
+/** SPD direct call extension (firmware specific extension space) */
+#define SBI_EXT_SPD_DIRECT			0x0A535044
+
+/** SPD direct call function IDs */
+enum spd_direct_fid {
+	/* a0-a4: fast call to the TEE, returns the TEE results in a0-a3 */
+	SPD_DIRECT_FID_FAST_CALL = 0,
+	/* a0-a3: results of the fast call, called by the TEE */
+	SPD_DIRECT_FID_COMPLETE = 1,
+};
+
+/** Per-HART SPD state resolved by spd_srv_setup() */
+struct spd_hart_state {
+	/** HART index of this HART */
+	u32 hartindex;
+	/** RPXY state of the TEE domain on this HART */
+	struct rpxy_state *trs;
+	/** RPXY state of the untrusted domain on this HART */
+	struct rpxy_state *urs;
+	/** Context of the TEE domain on this HART */
+	struct sbi_context *tctx;
+	/** Is a direct fast call in progress on this HART */
+	bool in_direct_call;
+};
+
+static struct sbi_domain *spd_tdomain;
+static struct sbi_domain *spd_udomain;
+static unsigned long spd_hart_state_offset;
+
+#define spd_thishart_state()					\
+	((struct spd_hart_state *)				\
+	 sbi_scratch_thishart_offset_ptr(spd_hart_state_offset))
+
+static struct sbi_domain *spd_find_domain(const char *name)
+{
+	int i;
+	struct sbi_domain *dom;
+
+	sbi_domain_for_each(i, dom) {
+		if (!sbi_strcmp(dom->name, name))
+			return dom;
+	}
+
+	return NULL;
+}
 
 int spd_srv_setup(void *fdt, int nodeoff, const struct fdt_match *match)
 {
 	const u32 *prop_instance;
+	struct spd_hart_state *hs;
+	struct sbi_scratch *scratch;
 	int len, offset;
+	u32 i;
 
 	prop_instance = fdt_getprop(fdt, nodeoff, "opensbi-domain-instance", &len);
 	if (!prop_instance || len < 4) {
@@ -62,64 +116,60 @@ int spd_srv_setup(void *fdt, int nodeoff, const struct fdt_match *match)
 		return SBI_EINVAL;
 	}
 
-	strncpy(spd_domain_name, fdt_get_name(fdt, offset, NULL),
-		sizeof(spd_domain_name));
-	spd_domain_name[sizeof(spd_domain_name) - 1] = '\0';
+	/* Domains are final at this point, resolve them only once */
+	spd_tdomain = spd_find_domain(fdt_get_name(fdt, offset, NULL));
+	if (!spd_tdomain) {
+		sbi_printf("%s: TEE domain not found\n", __func__);
+		return SBI_EINVAL;
+	}
 
-	return 0;
-}
+	/* Without an untrusted domain, replies and direct calls are off */
+	spd_udomain = spd_find_domain("untrusted-domain");
 
-static struct sbi_domain *__get_tdomain(void)
-{
-	int i;
-	struct sbi_domain *dom = NULL;
-	sbi_domain_for_each(i, dom)
-	{
-		if (!sbi_strcmp(dom->name, spd_domain_name)) {
-			return dom;
-		}
+	spd_hart_state_offset = sbi_scratch_alloc_type_offset(
+						struct spd_hart_state);
+	if (!spd_hart_state_offset)
+		return SBI_ENOMEM;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+
+		hs = sbi_scratch_offset_ptr(scratch, spd_hart_state_offset);
+		hs->hartindex = i;
+		hs->trs = sbi_hartindex_to_domain_rs(i, spd_tdomain);
+		hs->urs = spd_udomain ?
+			  sbi_hartindex_to_domain_rs(i, spd_udomain) : NULL;
+		hs->tctx = sbi_hartindex_to_domain_context(i, spd_tdomain);
+		hs->in_direct_call = false;
 	}
 
-	return NULL;
+	return 0;
 }
 
-static struct sbi_domain *__get_udomain(void)
+/* Context of the calling HART in its current domain */
+static struct sbi_context *spd_current_context(struct spd_hart_state *hs)
 {
-	int i;
-	struct sbi_domain *dom = NULL;
-	sbi_domain_for_each(i, dom)
-	{
-		if (!sbi_strcmp(dom->name, "untrusted-domain")) {
-			return dom;
-		}
-	}
-
-	return NULL;
+	return sbi_hartindex_to_domain_context(hs->hartindex,
+				sbi_hartindex_to_domain(hs->hartindex));
 }
 
-static int sbi_ecall_tee_domain_enter(unsigned long entry_point)
+static int spd_tee_domain_enter(struct spd_hart_state *hs,
+				unsigned long entry_point)
 {
-	int i;
-	struct sbi_domain *dom, *tdom = NULL;
-	sbi_domain_for_each(i, dom)
-	{
-		if (!sbi_strcmp(dom->name, spd_domain_name)) {
-			tdom = dom;
-			break;
-		}
-	}
+	if (!hs->tctx)
+		return SBI_EINVAL;
 
-	if (tdom) {
-		sbi_domain_context_set_mepc(tdom, entry_point);
-		sbi_domain_context_enter(tdom);
-	}
-	return 0;
+	/* Point to the last instruction address, ecall return adds 4 */
+	hs->tctx->regs.mepc = entry_point - 4;
+
+	return sbi_domain_context_enter_ctx(spd_current_context(hs), hs->tctx);
 }
 
-static int sbi_ecall_tee_domain_exit(void)
+static int spd_tee_domain_exit(struct spd_hart_state *hs)
 {
-	sbi_domain_context_exit();
-	return 0;
+	return sbi_domain_context_exit_ctx(hs->tctx);
 }
 
 static int spd_srv_handler(struct sbi_rpxy_service_group *grp,
@@ -129,43 +179,135 @@ static int spd_srv_handler(struct sbi_rpxy_service_group *grp,
 				  unsigned long *ack_len)
 {
 	int srv_id = srv->id;
-	struct rpxy_state *rs;
+	struct spd_hart_state *hs = spd_thishart_state();
+	unsigned long entry = 0;
 
 	if (SPD_BASE_SRV_COMMUNICATE == srv_id) {
-		/* Get per-hart RPXY share memory with tdomain */
-		rs = sbi_hartindex_to_domain_rs(
-			sbi_hartid_to_hartindex(current_hartid()), __get_tdomain());
-		sbi_memcpy((void *)rs->shmem_addr, tx, tx_len);
-		if (GET_ABI_ENTRY_TYPE(((ulong *)rs->shmem_addr)[0]) == ABI_ENTRY_TYPE_FAST) {
-			sbi_ecall_tee_domain_enter((unsigned long)
-					&entry_vector_table->fast_abi_entry);
-		} else {
-			sbi_ecall_tee_domain_enter((unsigned long)
-					&entry_vector_table->yield_abi_entry);
+		if (!hs->trs || !hs->trs->shmem_addr)
+			return SBI_ENO_SHMEM;
+
+		/* No copy when both worlds share the per-hart buffer */
+		if ((void *)hs->trs->shmem_addr != tx)
+			sbi_memcpy((void *)hs->trs->shmem_addr, tx, tx_len);
+
+		if (entry_vector_table) {
+			if (tx_len >= sizeof(unsigned long) &&
+			    GET_ABI_ENTRY_TYPE(((ulong *)tx)[0]) ==
+			    ABI_ENTRY_TYPE_FAST)
+				entry = (unsigned long)
+					&entry_vector_table->fast_abi_entry;
+			else
+				entry = (unsigned long)
+					&entry_vector_table->yield_abi_entry;
 		}
+
+		spd_tee_domain_enter(hs, entry);
 	} else if (SPD_BASE_SRV_COMPLETE == srv_id) {
-		/* Get per-hart RPXY share memory with udomain */
-		rs = sbi_hartindex_to_domain_rs(
-			sbi_hartid_to_hartindex(current_hartid()), __get_udomain());
-		if (rs->shmem_addr) {
-			/* tx has a0~a4. Just skip a0 and copy a1~a4 here */
-			sbi_memcpy((void *)rs->shmem_addr,
-				   &(((unsigned long *)tx)[1]),
-				   tx_len - sizeof(unsigned long));
+		if (tx_len < sizeof(unsigned long))
+			return SBI_EINVAL;
+
+		if (hs->urs && hs->urs->shmem_addr) {
+			/*
+			 * tx has a0~a4. Just skip a0 and copy a1~a4 here,
+			 * tx may be the same per-hart buffer.
+			 */
+			sbi_memmove((void *)hs->urs->shmem_addr,
+				    &(((unsigned long *)tx)[1]),
+				    tx_len - sizeof(unsigned long));
 			*ack_len = tx_len - sizeof(unsigned long);
 		} else {
 			if (((unsigned long *)tx)[0] == 0xBE000000) {
 				/* RETURN_INIT_DONE */
 				entry_vector_table = (struct abi_entry_vectors *) (((unsigned long *)tx)[1]);
 				sbi_printf("entry_vector_table = 0x%lX\n", (ulong)entry_vector_table);
+				/* Optional entry of direct fast calls */
+				if (tx_len >= 3 * sizeof(unsigned long))
+					direct_abi_entry =
+						((unsigned long *)tx)[2];
 			}
 		}
-		sbi_ecall_tee_domain_exit();
+		/* Any completion ends a pending direct call on this HART */
+		hs->in_direct_call = false;
+		spd_tee_domain_exit(hs);
 	}
 
 	return 0;
 }
 
+/*
+ * Direct fast calls pass the call and its results in registers and
+ * switch to the TEE without the RPXY service lookup, shared memory
+ * mapping and message copies.
+ */
+static int spd_direct_handler(unsigned long extid, unsigned long funcid,
+			      struct sbi_trap_regs *regs,
+			      struct sbi_ecall_return *out)
+{
+	struct spd_hart_state *hs = spd_thishart_state();
+	struct sbi_context *ctx = spd_current_context(hs);
+	unsigned long args[5];
+
+	switch (funcid) {
+	case SPD_DIRECT_FID_FAST_CALL:
+		if (!direct_abi_entry || !hs->tctx || hs->in_direct_call)
+			return SBI_ENOTSUPP;
+		/* Only the untrusted domain may call the TEE directly */
+		if (!ctx || ctx == hs->tctx || ctx->dom != spd_udomain)
+			return SBI_EDENIED;
+		if (GET_ABI_ENTRY_TYPE(regs->a0) != ABI_ENTRY_TYPE_FAST)
+			return SBI_EINVAL;
+
+		args[0] = regs->a0;
+		args[1] = regs->a1;
+		args[2] = regs->a2;
+		args[3] = regs->a3;
+		args[4] = regs->a4;
+
+		/* The caller resumes after the ecall with the TEE results */
+		regs->mepc += 4;
+		hs->tctx->regs.mepc = direct_abi_entry;
+		hs->in_direct_call = true;
+		sbi_domain_context_enter_ctx(ctx, hs->tctx);
+
+		/* Trap registers now belong to the TEE */
+		regs->a0 = args[0];
+		regs->a1 = args[1];
+		regs->a2 = args[2];
+		regs->a3 = args[3];
+		regs->a4 = args[4];
+		out->skip_regs_update = true;
+		return 0;
+	case SPD_DIRECT_FID_COMPLETE:
+		if (!hs->in_direct_call || ctx != hs->tctx)
+			return SBI_EDENIED;
+
+		args[0] = regs->a0;
+		args[1] = regs->a1;
+		args[2] = regs->a2;
+		args[3] = regs->a3;
+
+		regs->mepc += 4;
+		hs->in_direct_call = false;
+		spd_tee_domain_exit(hs);
+
+		/* Trap registers now belong to the caller */
+		regs->a0 = args[0];
+		regs->a1 = args[1];
+		regs->a2 = args[2];
+		regs->a3 = args[3];
+		out->skip_regs_update = true;
+		return 0;
+	default:
+		return SBI_ENOTSUPP;
+	}
+}
+
+static struct sbi_ecall_extension ecall_spd_direct = {
+	.extid_start		= SBI_EXT_SPD_DIRECT,
+	.extid_end		= SBI_EXT_SPD_DIRECT,
+	.handle			= spd_direct_handler,
+};
+
 static int rpxy_spd_init(void *fdt, int nodeoff,
 			  const struct fdt_match *match)
 {
@@ -182,7 +324,7 @@ static int rpxy_spd_init(void *fdt, int nodeoff,
 	rc = spd_srv_setup(fdt, nodeoff, match);
 	if (rc) {
 		sbi_free(group);
-		return 0;
+		return rc;
 	}
 
 	/* Setup RPXY service group */
@@ -193,9 +335,20 @@ static int rpxy_spd_init(void *fdt, int nodeoff,
 	group->num_services = data->num_services;
 	group->services = data->services;
 	group->send_message = spd_srv_handler;
+	/* Register direct fast call path for the untrusted domain */
+	if (spd_udomain) {
+		rc = sbi_ecall_register_extension(&ecall_spd_direct);
+		if (rc) {
+			sbi_free(group);
+			return rc;
+		}
+	}
+
 	/* Register RPXY service group */
 	rc = sbi_rpxy_register_service_group(group);
 	if (rc) {
+		if (spd_udomain)
+			sbi_ecall_unregister_extension(&ecall_spd_direct);
 		sbi_free(group);
 		return rc;
 	}
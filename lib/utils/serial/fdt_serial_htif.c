@@ -7,6 +7,7 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <libfdt.h>
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_domain.h>
 #include <sbi_utils/fdt/fdt_helper.h>
@@ -22,7 +23,7 @@ static int serial_htif_init(void *fdt, int nodeoff,
 			    const struct fdt_match *match)
 {
 	int rc;
-	bool custom = false;
+	bool custom = false, bulk_write;
 	uint64_t fromhost_addr = 0, tohost_addr = 0;
 
 	if (!fdt_get_node_addr_size(fdt, nodeoff, 0, &fromhost_addr, NULL)) {
@@ -38,7 +39,12 @@ static int serial_htif_init(void *fdt, int nodeoff,
 	if (rc)
 		return rc;
 
-	return htif_serial_init(custom, fromhost_addr, tohost_addr);
+	/* Only hosts such as Spike proxy write calls of any length */
+	bulk_write = fdt_getprop(fdt, nodeoff, "opensbi,htif-bulk-write",
+				 NULL) ? true : false;
+
+	return htif_serial_init(custom, fromhost_addr, tohost_addr,
+				bulk_write);
 }
 
 struct fdt_serial fdt_serial_htif = {
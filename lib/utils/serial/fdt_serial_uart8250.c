@@ -7,6 +7,7 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <libfdt.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/serial/fdt_serial.h>
 #include <sbi_utils/serial/uart8250.h>
@@ -14,16 +15,26 @@
 static int serial_uart8250_init(void *fdt, int nodeoff,
 				const struct fdt_match *match)
 {
-	int rc;
+	int rc, len;
+	const fdt32_t *val;
 	struct platform_uart_data uart = { 0 };
 
 	rc = fdt_parse_uart_node(fdt, nodeoff, &uart);
 	if (rc)
 		return rc;
 
-	return uart8250_init(uart.addr, uart.freq, uart.baud,
-			     uart.reg_shift, uart.reg_io_width,
-			     uart.reg_offset);
+	rc = uart8250_init(uart.addr, uart.freq, uart.baud,
+			   uart.reg_shift, uart.reg_io_width,
+			   uart.reg_offset);
+	if (rc)
+		return rc;
+
+	/* Override the probed FIFO depth */
+	val = fdt_getprop(fdt, nodeoff, "fifo-size", &len);
+	if (len > 0 && val)
+		uart8250_set_fifo_size(fdt32_to_cpu(*val));
+
+	return 0;
 }
 
 static const struct fdt_match serial_uart8250_match[] = {
@@ -29,6 +29,8 @@
 #define UART_SCR_OFFSET		7	/* I/O: Scratch Register */
 #define UART_MDR1_OFFSET	8	/* I/O:  Mode Register */
 
+#define UART_IIR_FIFO_MASK	0xC0	/* FIFOs enabled */
+
 #define UART_LSR_FIFOE		0x80	/* Fifo error */
 #define UART_LSR_TEMT		0x40	/* Transmitter empty */
 #define UART_LSR_THRE		0x20	/* Transmit-hold-register empty */
@@ -46,6 +48,7 @@ static u32 uart8250_in_freq;
 static u32 uart8250_baudrate;
 static u32 uart8250_reg_width;
 static u32 uart8250_reg_shift;
+static u32 uart8250_fifo_size = 1;
 
 static u32 get_reg(u32 num)
 {
@@ -79,6 +82,33 @@ static void uart8250_putc(char ch)
 	set_reg(UART_THR_OFFSET, ch);
 }
 
+static unsigned long uart8250_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	bool cr_sent = false;
+	u32 room = 0;
+
+	while (i < len) {
+		/* THRE means the whole transmit FIFO is empty */
+		if (!room) {
+			while ((get_reg(UART_LSR_OFFSET) & UART_LSR_THRE) == 0)
+				;
+			room = uart8250_fifo_size;
+		}
+
+		if (str[i] == '\n' && !cr_sent) {
+			set_reg(UART_THR_OFFSET, '\r');
+			cr_sent = true;
+		} else {
+			set_reg(UART_THR_OFFSET, str[i++]);
+			cr_sent = false;
+		}
+		room--;
+	}
+
+	return len;
+}
+
 static int uart8250_getc(void)
 {
 	if (get_reg(UART_LSR_OFFSET) & UART_LSR_DR)
@@ -89,9 +119,16 @@ static int uart8250_getc(void)
 static struct sbi_console_device uart8250_console = {
 	.name = "uart8250",
 	.console_putc = uart8250_putc,
+	.console_puts = uart8250_puts,
 	.console_getc = uart8250_getc
 };
 
+void uart8250_set_fifo_size(u32 fifo_size)
+{
+	if (fifo_size)
+		uart8250_fifo_size = fifo_size;
+}
+
 int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 		  u32 reg_width, u32 reg_offset)
 {
@@ -124,6 +161,12 @@ int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 	set_reg(UART_LCR_OFFSET, 0x03);
 	/* Enable FIFO */
 	set_reg(UART_FCR_OFFSET, 0x01);
+	/* A 16550A or later reports working FIFOs of at least 16 bytes */
+	if ((get_reg(UART_IIR_OFFSET) & UART_IIR_FIFO_MASK) ==
+	    UART_IIR_FIFO_MASK)
+		uart8250_fifo_size = 16;
+	else
+		uart8250_fifo_size = 1;
 	/* No modem control DTR RTS */
 	set_reg(UART_MCR_OFFSET, 0x00);
 	/* Clear line status */
@@ -44,6 +44,8 @@
 #define FROMHOST_DATA(fromhost_value) \
 	((uint64_t)((fromhost_value) >> HTIF_DATA_SHIFT) & HTIF_DATA_MASK)
 
+#define HTIF_CONSOLE_FD_STDOUT	1
+
 #define PK_SYS_write 64
 
 volatile uint64_t tohost __attribute__((section(".htif")));
@@ -127,11 +129,8 @@ static int set_custom_addr(bool custom_addr,
 	return 0;
 }
 
-#if __riscv_xlen == 32
-static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
+static void __do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 {
-	spin_lock(&htif_lock);
-
 	__set_tohost(HTIF_DEV_SYSTEM, cmd, data);
 
 	while (1) {
@@ -145,19 +144,26 @@ static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 			__check_fromhost();
 		}
 	}
+}
 
-	spin_unlock(&htif_lock);
+static void __htif_write(const char *str, unsigned long len)
+{
+	/* Proxy write call which sends the whole buffer in one handshake */
+	volatile uint64_t magic_mem[8] __aligned(64);
+	magic_mem[0] = PK_SYS_write;
+	magic_mem[1] = HTIF_CONSOLE_FD_STDOUT;
+	magic_mem[2] = (uint64_t)(uintptr_t)str;
+	magic_mem[3] = len;
+	__do_tohost_fromhost(HTIF_DEV_SYSTEM, 0, (uint64_t)(uintptr_t)magic_mem);
 }
 
+#if __riscv_xlen == 32
 static void htif_putc(char ch)
 {
 	/* HTIF devices are not supported on RV32, so do a proxy write call */
-	volatile uint64_t magic_mem[8];
-	magic_mem[0] = PK_SYS_write;
-	magic_mem[1] = HTIF_DEV_CONSOLE;
-	magic_mem[2] = (uint64_t)(uintptr_t)&ch;
-	magic_mem[3] = HTIF_CONSOLE_CMD_PUTC;
-	do_tohost_fromhost(HTIF_DEV_SYSTEM, 0, (uint64_t)(uintptr_t)magic_mem);
+	spin_lock(&htif_lock);
+	__htif_write(&ch, 1);
+	spin_unlock(&htif_lock);
 }
 #else
 static void htif_putc(char ch)
@@ -168,6 +174,63 @@ static void htif_putc(char ch)
 }
 #endif
 
+#define HTIF_CONSOLE_OUTBUF_SIZE	128
+
+static char htif_console_outbuf[HTIF_CONSOLE_OUTBUF_SIZE];
+static unsigned long htif_console_outlen;
+
+static void __htif_flush(void)
+{
+	if (htif_console_outlen) {
+		__htif_write(htif_console_outbuf, htif_console_outlen);
+		htif_console_outlen = 0;
+	}
+}
+
+static void __htif_outbuf_add(char ch)
+{
+	if (htif_console_outlen == HTIF_CONSOLE_OUTBUF_SIZE)
+		__htif_flush();
+	htif_console_outbuf[htif_console_outlen++] = ch;
+}
+
+static void __htif_puts(const char *str, unsigned long len)
+{
+	unsigned long i;
+
+	/* The host writes the buffer as is, so send LF as CR LF */
+	for (i = 0; i < len; i++) {
+		if (str[i] == '\n')
+			__htif_outbuf_add('\r');
+		__htif_outbuf_add(str[i]);
+#ifdef CONFIG_SYS_HTIF_CONSOLE_BUFFERED
+		/* Send complete lines, or the buffer when it is full */
+		if (str[i] == '\n')
+			__htif_flush();
+#endif
+	}
+
+#ifndef CONFIG_SYS_HTIF_CONSOLE_BUFFERED
+	__htif_flush();
+#endif
+}
+
+static unsigned long htif_puts(const char *str, unsigned long len)
+{
+	spin_lock(&htif_lock);
+	__htif_puts(str, len);
+	spin_unlock(&htif_lock);
+
+	return len;
+}
+
+static void htif_flush(void)
+{
+	spin_lock(&htif_lock);
+	__htif_flush();
+	spin_unlock(&htif_lock);
+}
+
 static int htif_getc(void)
 {
 	int ch;
@@ -179,6 +242,9 @@ static int htif_getc(void)
 
 	spin_lock(&htif_lock);
 
+	/* Show pending output (such as a prompt) before reading input */
+	__htif_flush();
+
 	__check_fromhost();
 	ch = htif_console_buf;
 	if (ch >= 0) {
@@ -194,12 +260,14 @@ static int htif_getc(void)
 static struct sbi_console_device htif_console = {
 	.name = "htif",
 	.console_putc = htif_putc,
-	.console_getc = htif_getc
+	.console_getc = htif_getc,
+	.console_flush = htif_flush
 };
 
 int htif_serial_init(bool custom_addr,
 		     unsigned long custom_fromhost_addr,
-		     unsigned long custom_tohost_addr)
+		     unsigned long custom_tohost_addr,
+		     bool bulk_write)
 {
 	int rc;
 
@@ -208,6 +276,14 @@ int htif_serial_init(bool custom_addr,
 	if (rc)
 		return rc;
 
+	/*
+	 * Not every host proxies write calls longer than one character
+	 * (QEMU does not), so strings are written character by character
+	 * unless the host is known to support bulk writes.
+	 */
+	if (bulk_write)
+		htif_console.console_puts = htif_puts;
+
 	sbi_console_set_device(&htif_console);
 	return 0;
 }
@@ -219,6 +295,8 @@ static int htif_system_reset_check(u32 type, u32 reason)
 
 static void htif_system_reset(u32 type, u32 reason)
 {
+	htif_flush();
+
 	while (1) {
 		__write_fromhost(0);
 		__write_tohost(1);
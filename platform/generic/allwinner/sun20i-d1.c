@@ -13,6 +13,7 @@
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_hsm.h>
+#include <sbi/sbi_hsm_idle.h>
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
@@ -196,16 +197,6 @@ static const struct sbi_hsm_device sun20i_d1_ppu = {
 	.hart_resume	= sun20i_d1_hart_resume,
 };
 
-static int sun20i_d1_final_init(bool cold_boot, const struct fdt_match *match)
-{
-	if (cold_boot) {
-		sun20i_d1_riscv_cfg_init();
-		sbi_hsm_set_device(&sun20i_d1_ppu);
-	}
-
-	return 0;
-}
-
 static const struct sbi_cpu_idle_state sun20i_d1_cpu_idle_states[] = {
 	{
 		.name			= "cpu-nonretentive",
@@ -219,6 +210,17 @@ static const struct sbi_cpu_idle_state sun20i_d1_cpu_idle_states[] = {
 	{ }
 };
 
+static int sun20i_d1_final_init(bool cold_boot, const struct fdt_match *match)
+{
+	if (cold_boot) {
+		sun20i_d1_riscv_cfg_init();
+		sbi_hsm_set_device(&sun20i_d1_ppu);
+		return sbi_hsm_idle_set_states(sun20i_d1_cpu_idle_states);
+	}
+
+	return 0;
+}
+
 static int sun20i_d1_fdt_fixup(void *fdt, const struct fdt_match *match)
 {
 	return fdt_add_cpu_idle_states(fdt, sun20i_d1_cpu_idle_states);
@@ -9,6 +9,7 @@
 
 #include <platform_override.h>
 #include <andes/andes_pmu.h>
+#include <andes/andes_sbi.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/sys/atcsmu.h>
@@ -117,6 +118,7 @@ static const struct fdt_match andes_ae350_match[] = {
 const struct platform_override andes_ae350 = {
 	.match_table = andes_ae350_match,
 	.final_init  = ae350_final_init,
+	.vendor_ext_provider = andes_sbi_vendor_ext_provider,
 	.extensions_init = andes_pmu_extensions_init,
 	.pmu_init = andes_pmu_init,
 };
@@ -17,6 +17,7 @@
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_error.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
 
 /* Configuration Registers */
 #define ANDES45_CSR_MMSC_CFG		0xFC2
@@ -333,6 +334,7 @@ int andes45_pma_setup_regions(const struct andes45_pma_region *pma_regions,
 
 	fdt = fdt_get_address();
 
+	fdt_index_invalidate();
 	ret = fdt_open_into(fdt, fdt, fdt_totalsize(fdt) + (64 * dt_populate_cnt));
 	if (ret < 0)
 		return ret;
@@ -8,10 +8,45 @@
 #include <andes/andes45.h>
 #include <andes/andes_pmu.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_pmu.h>
+#include <sbi_utils/fdt/fdt_helper.h>
 #include <libfdt.h>
 
+#define ANDES_PMU_CACHE_EVENT(__id, __op, __result)			\
+	((SBI_PMU_EVENT_TYPE_HW_CACHE << SBI_PMU_EVENT_IDX_TYPE_OFFSET) | \
+	 (SBI_PMU_HW_CACHE_##__id << 3) |				\
+	 (SBI_PMU_HW_CACHE_OP_##__op << 1) |				\
+	 SBI_PMU_HW_CACHE_RESULT_##__result)
+
+/*
+ * Default mapping of SBI hardware events to mhpmevent values of the
+ * 45-series, used when the device tree does not provide one. See the
+ * "Machine Performance Monitoring Event Selector" section of the
+ * AX45MP datasheet.
+ */
+static const struct fdt_pmu_hw_event_select_map andes45_hw_events[] = {
+	{ SBI_PMU_HW_CPU_CYCLES,		0x10 },	/* Cycle count */
+	{ SBI_PMU_HW_INSTRUCTIONS,		0x20 },	/* Retired instructions */
+	{ SBI_PMU_HW_CACHE_REFERENCES,		0x41 },	/* D-Cache access */
+	{ SBI_PMU_HW_CACHE_MISSES,		0x51 },	/* D-Cache miss */
+	{ SBI_PMU_HW_BRANCH_INSTRUCTIONS,	0x80 },	/* Conditional branches */
+	{ SBI_PMU_HW_BRANCH_MISSES,		0x02 },	/* Conditional mispredicts */
+	{ ANDES_PMU_CACHE_EVENT(L1D, READ, ACCESS),	0x61 },	/* D-Cache load access */
+	{ ANDES_PMU_CACHE_EVENT(L1D, READ, MISS),	0x71 },	/* D-Cache load miss */
+	{ ANDES_PMU_CACHE_EVENT(L1D, WRITE, ACCESS),	0x81 },	/* D-Cache store access */
+	{ ANDES_PMU_CACHE_EVENT(L1D, WRITE, MISS),	0x91 },	/* D-Cache store miss */
+	{ ANDES_PMU_CACHE_EVENT(L1I, READ, ACCESS),	0x21 },	/* I-Cache access */
+	{ ANDES_PMU_CACHE_EVENT(L1I, READ, MISS),	0x31 },	/* I-Cache miss */
+	{ ANDES_PMU_CACHE_EVENT(DTLB, READ, ACCESS),	0x131 },/* Main DTLB access */
+	{ ANDES_PMU_CACHE_EVENT(DTLB, READ, MISS),	0x141 },/* Main DTLB miss */
+	{ ANDES_PMU_CACHE_EVENT(ITLB, READ, ACCESS),	0x111 },/* Main ITLB access */
+	{ ANDES_PMU_CACHE_EVENT(ITLB, READ, MISS),	0x121 },/* Main ITLB miss */
+	{ ANDES_PMU_CACHE_EVENT(BPU, READ, ACCESS),	0x80 },	/* Conditional branches */
+	{ ANDES_PMU_CACHE_EVENT(BPU, READ, MISS),	0x02 },	/* Conditional mispredicts */
+};
+
 static void andes_hw_counter_enable_irq(uint32_t ctr_idx)
 {
 	unsigned long mip_val;
@@ -31,6 +66,12 @@ static void andes_hw_counter_disable_irq(uint32_t ctr_idx)
 	csr_clear(CSR_MCOUNTERINTEN, BIT(ctr_idx));
 }
 
+static void andes_counter_overflow_raise_irq(void)
+{
+	/* Overflow interrupt is delegated to S-mode through mslideleg */
+	csr_set(CSR_SLIP, MIP_PMOVI);
+}
+
 static void andes_hw_counter_filter_mode(unsigned long flags, int ctr_idx)
 {
 	if (flags & SBI_PMU_CFG_FLAG_SET_UINH)
@@ -54,7 +95,8 @@ static struct sbi_pmu_device andes_pmu = {
 	 * hw_counter_irq_bit() callback unimplemented.
 	 */
 	.hw_counter_irq_bit     = NULL,
-	.hw_counter_filter_mode = andes_hw_counter_filter_mode
+	.hw_counter_filter_mode = andes_hw_counter_filter_mode,
+	.counter_overflow_raise_irq = andes_counter_overflow_raise_irq,
 };
 
 int andes_pmu_extensions_init(const struct fdt_match *match,
@@ -82,12 +124,60 @@ int andes_pmu_extensions_init(const struct fdt_match *match,
 	return 0;
 }
 
+static bool andes_pmu_fdt_has_event_map(void *fdt)
+{
+	int pmu_offset;
+
+	if (!fdt)
+		return false;
+
+	pmu_offset = fdt_node_offset_by_compatible(fdt, -1, "riscv,pmu");
+	if (pmu_offset < 0)
+		return false;
+
+	return fdt_getprop(fdt, pmu_offset,
+			   "riscv,event-to-mhpmevent", NULL) ||
+	       fdt_getprop(fdt, pmu_offset,
+			   "riscv,event-to-mhpmcounters", NULL);
+}
+
+static int andes45_pmu_add_default_events(struct sbi_scratch *scratch)
+{
+	u32 i, ctr_map;
+	int rc;
+
+	/* Any programmable counter can count any event */
+	ctr_map = sbi_hart_mhpm_mask(scratch) & ~SBI_PMU_FIXED_CTR_MASK;
+	if (!ctr_map)
+		return 0;
+
+	for (i = 0; i < array_size(andes45_hw_events); i++) {
+		if (hw_event_count >= FDT_PMU_HW_EVENT_MAX)
+			return SBI_ENOSPC;
+
+		rc = sbi_pmu_add_hw_event_counter_map(andes45_hw_events[i].eidx,
+						      andes45_hw_events[i].eidx,
+						      ctr_map);
+		if (rc)
+			return rc;
+
+		fdt_pmu_evt_select[hw_event_count++] = andes45_hw_events[i];
+	}
+
+	return 0;
+}
+
 int andes_pmu_init(const struct fdt_match *match)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 
-	if (sbi_hart_has_extension(scratch, SBI_HART_EXT_XANDESPMU))
-		sbi_pmu_set_device(&andes_pmu);
+	if (!sbi_hart_has_extension(scratch, SBI_HART_EXT_XANDESPMU))
+		return 0;
+
+	sbi_pmu_set_device(&andes_pmu);
+
+	if (is_andes(45) && !andes_pmu_fdt_has_event_map(fdt_get_address()))
+		return andes45_pmu_add_default_events(scratch);
 
 	return 0;
 }
@@ -15,6 +15,9 @@
 /* Machine Trap Related Registers */
 #define CSR_MSLIDELEG		0x7d5
 
+/* Supervisor Trap Related Registers */
+#define CSR_SLIP		0x9c5
+
 /* Counter Related Registers */
 #define CSR_MCOUNTERWEN		0x7ce
 #define CSR_MCOUNTERINTEN	0x7cf
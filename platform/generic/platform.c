@@ -11,15 +11,19 @@
 #include <platform_override.h>
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_bitops.h>
+#include <sbi/sbi_console.h>
 #include <sbi/sbi_hartmask.h>
 #include <sbi/sbi_heap.h>
+#include <sbi/sbi_hsm_idle.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_system.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
 #include <sbi_utils/fdt/fdt_domain.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
 #include <sbi_utils/fdt/fdt_helper.h>
+#include <sbi_utils/fdt/fdt_index.h>
 #include <sbi_utils/fdt/fdt_pmu.h>
 #include <sbi_utils/irqchip/fdt_irqchip.h>
 #include <sbi_utils/irqchip/imsic.h>
@@ -58,7 +62,7 @@ static void fw_platform_lookup_special(void *fdt, int root_offset)
 	}
 }
 
-static u32 fw_platform_calculate_heap_size(u32 hart_count)
+static u32 fw_platform_calculate_heap_size(const void *fdt, u32 hart_count)
 {
 	u32 heap_size;
 
@@ -67,6 +71,18 @@ static u32 fw_platform_calculate_heap_size(u32 hart_count)
 	/* For TLB fifo */
 	heap_size += SBI_TLB_INFO_SIZE * (hart_count) * (hart_count);
 
+	/* For slabs cached by each HART */
+	heap_size += SBI_HEAP_HART_CACHE_SIZE * (hart_count);
+
+	/* For buffered console rings */
+	heap_size += SBI_CONSOLE_RING_HEAP_SIZE * (hart_count);
+
+	/* For trace rings */
+	heap_size += SBI_TRACE_RING_HEAP_SIZE * (hart_count);
+
+	/* For FDT lookup index */
+	heap_size += fdt_index_heap_size(fdt);
+
 	return BIT_ALIGN(heap_size, HEAP_BASE_ALIGN);
 }
 
@@ -186,7 +202,7 @@ unsigned long fw_platform_init(unsigned long arg0, unsigned long arg1,
 	}
 
 	platform.hart_count = hart_count;
-	platform.heap_size = fw_platform_calculate_heap_size(hart_count);
+	platform.heap_size = fw_platform_calculate_heap_size(fdt, hart_count);
 	platform_has_mlevel_imsic = fdt_check_imsic_mlevel(fdt);
 
 	fw_platform_coldboot_harts_init(fdt);
@@ -222,8 +238,19 @@ static int generic_nascent_init(void)
 
 static int generic_early_init(bool cold_boot)
 {
-	if (cold_boot)
+	int rc;
+
+	if (cold_boot) {
+		/*
+		 * The heap is not ready in fw_platform_init() so index the
+		 * FDT here. Without the index, lookups scan the FDT.
+		 */
+		rc = fdt_index_build(fdt_get_address());
+		if (rc)
+			sbi_printf("%s: FDT index not built (error %d), "
+				   "using FDT scans\n", __func__, rc);
 		fdt_reset_init();
+	}
 
 	if (!generic_plat || !generic_plat->early_init)
 		return 0;
@@ -247,9 +274,22 @@ static int generic_final_init(bool cold_boot)
 
 	fdt = fdt_get_address();
 
-	fdt_cpu_fixup(fdt);
-	fdt_fixups(fdt);
-	fdt_domain_fixup(fdt);
+	/* Emit the FDT once for all the generic fixups */
+	rc = fdt_fixup_begin(fdt);
+	if (!rc) {
+		fdt_cpu_fixup(fdt);
+		fdt_fixups(fdt);
+		fdt_domain_fixup(fdt);
+		rc = fdt_fixup_end(fdt);
+	}
+	if (rc) {
+		/* Smaller batches may still fit so retry them separately */
+		sbi_printf("%s: retrying generic DT fixups separately\n",
+			   __func__);
+		fdt_cpu_fixup(fdt);
+		fdt_fixups(fdt);
+		fdt_domain_fixup(fdt);
+	}
 
 	if (generic_plat && generic_plat->fdt_fixup) {
 		rc = generic_plat->fdt_fixup(fdt, generic_plat_match);
@@ -257,6 +297,13 @@ static int generic_final_init(bool cold_boot)
 			return rc;
 	}
 
+	/* Describe idle states known to the HSM idle governor */
+	if (sbi_hsm_idle_get_states()) {
+		rc = fdt_add_cpu_idle_states(fdt, sbi_hsm_idle_get_states());
+		if (rc)
+			return rc;
+	}
+
 	return 0;
 }
 
@@ -321,6 +368,9 @@ static int generic_domains_init(void)
 		if (offset >= 0 &&
 		    fdt_get_property(fdt, offset, "system-suspend-test", NULL))
 			sbi_system_suspend_test_enable();
+		if (offset >= 0 &&
+		    fdt_get_property(fdt, offset, "hsm-idle-test", NULL))
+			sbi_hsm_idle_test_enable();
 	}
 
 	return 0;
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-2-Clause
+#
+# Copyright (c) 2024 Andes Technology Corporation
+#
+# Decode OpenSBI binary trace rings (CONFIG_SBI_TRACE).
+#
+# The input is either a raw memory dump containing the trace rings, or
+# console output of sbi_trace_dump() (lines starting with "SBITRACE").
+# The ring layout is described in include/sbi/sbi_trace.h.
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544253
+TRACE_VERSION = 1
+
+# struct sbi_trace_ring (without records)
+RING_FMT = '<IHHIIQQ32x'
+RING_SIZE = struct.calcsize(RING_FMT)
+# struct sbi_trace_record
+RECORD_FMT = '<QII4Q'
+RECORD_SIZE = struct.calcsize(RECORD_FMT)
+
+EVENTS = {
+    1: ('ecall_enter', ('ext', 'fid', 'a0', 'a1')),
+    2: ('ecall_exit', ('ext', 'fid', 'error', 'value')),
+    3: ('ipi_send', ('target', 'event')),
+    4: ('ipi_process', ('events',)),
+    5: ('rfence', ('type', 'start', 'size', 'id')),
+    6: ('hsm_state', ('target', 'old', 'new')),
+}
+
+EXTENSIONS = {
+    0x0: 'legacy_set_timer', 0x1: 'legacy_putchar', 0x2: 'legacy_getchar',
+    0x3: 'legacy_clear_ipi', 0x4: 'legacy_send_ipi',
+    0x5: 'legacy_fence_i', 0x6: 'legacy_sfence_vma',
+    0x7: 'legacy_sfence_vma_asid', 0x8: 'legacy_shutdown',
+    0x10: 'base', 0x54494D45: 'time', 0x735049: 'ipi',
+    0x52464E43: 'rfence', 0x48534D: 'hsm', 0x53525354: 'srst',
+    0x504D55: 'pmu', 0x4442434E: 'dbcn', 0x53555350: 'susp',
+    0x43505043: 'cppc', 0x44425452: 'dbtr', 0x52505859: 'rpxy',
+}
+
+HSM_STATES = ('started', 'stopped', 'start_pending', 'stop_pending',
+              'suspended', 'suspend_pending', 'resume_pending')
+
+TLB_TYPES = ('fence_i', 'sfence_vma', 'sfence_vma_asid',
+             'hfence_gvma_vmid', 'hfence_gvma', 'hfence_vvma_asid',
+             'hfence_vvma')
+
+
+def signed64(val):
+    return val - (1 << 64) if val & (1 << 63) else val
+
+
+def read_input(path, hex_input):
+    if path == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(path, 'rb') as f:
+            data = f.read()
+    if not hex_input:
+        return data
+    out = bytearray()
+    for line in data.decode('ascii', 'replace').splitlines():
+        m = re.search(r'SBITRACE ([0-9a-fA-F]+)', line)
+        if m:
+            out += bytes.fromhex(m.group(1))
+    return bytes(out)
+
+
+def find_rings(data):
+    rings = []
+    magic = struct.pack('<I', TRACE_MAGIC)
+    pos = data.find(magic)
+    while pos >= 0:
+        hdr = data[pos:pos + RING_SIZE]
+        if len(hdr) == RING_SIZE:
+            (_, version, record_size, hartid, nr_records, head,
+             timer_freq) = struct.unpack(RING_FMT, hdr)
+            end = pos + RING_SIZE + nr_records * record_size
+            if (version == TRACE_VERSION and record_size == RECORD_SIZE
+                    and nr_records and end <= len(data)):
+                rings.append((hartid, nr_records, head, timer_freq,
+                              data[pos + RING_SIZE:end]))
+                pos = data.find(magic, end)
+                continue
+        pos = data.find(magic, pos + 1)
+    return rings
+
+
+def ring_records(ring):
+    hartid, nr_records, head, timer_freq, body = ring
+    first = head - nr_records if head > nr_records else 0
+    for i in range(first, head):
+        off = (i % nr_records) * RECORD_SIZE
+        time, rhart, event, *args = struct.unpack(
+            RECORD_FMT, body[off:off + RECORD_SIZE])
+        if event:
+            yield (time, rhart, event, args)
+
+
+def format_args(event, args):
+    name, argn = EVENTS.get(event, ('event%d' % event, ('a0', 'a1', 'a2',
+                                                         'a3')))
+    vals = dict(zip(argn, args))
+    if event in (1, 2):
+        vals['ext'] = EXTENSIONS.get(vals['ext'], hex(vals['ext']))
+    if event == 2:
+        vals['error'] = signed64(vals['error'])
+    if event == 5 and vals['type'] < len(TLB_TYPES):
+        vals['type'] = TLB_TYPES[vals['type']]
+    if event == 6:
+        for k in ('old', 'new'):
+            if vals[k] < len(HSM_STATES):
+                vals[k] = HSM_STATES[vals[k]]
+    return name, vals
+
+
+def to_us(time, freq):
+    return time * 1000000.0 / freq if freq else float(time)
+
+
+def print_text(records, freq, out):
+    unit = 'us' if freq else 'ticks'
+    for time, hart, event, args in records:
+        name, vals = format_args(event, args)
+        argstr = ' '.join('%s=%s' % (k, hex(v) if isinstance(v, int)
+                                     and k not in ('error', 'target')
+                                     else v)
+                          for k, v in vals.items())
+        out.write('%16.3f %s hart%-3d %-12s %s\n' %
+                  (to_us(time, freq), unit, hart, name, argstr))
+
+
+def print_chrome(records, freq, out):
+    events = []
+    for time, hart, event, args in records:
+        name, vals = format_args(event, args)
+        ev = {'pid': 0, 'tid': hart, 'ts': to_us(time, freq),
+              'args': {k: (hex(v) if isinstance(v, int) else v)
+                       for k, v in vals.items()}}
+        if event == 1:
+            ev.update(name='ecall %s' % vals['ext'], ph='B')
+        elif event == 2:
+            ev.update(name='ecall %s' % vals['ext'], ph='E')
+        else:
+            ev.update(name=name, ph='i', s='t')
+        events.append(ev)
+    json.dump({'traceEvents': events, 'displayTimeUnit': 'ns'}, out,
+              indent=1)
+    out.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Decode OpenSBI binary trace rings')
+    parser.add_argument('input', help='memory dump or console log '
+                        '("-" for stdin)')
+    parser.add_argument('--hex', action='store_true',
+                        help='input is console output of sbi_trace_dump()')
+    parser.add_argument('--chrome', action='store_true',
+                        help='output Chrome trace JSON instead of text')
+    parser.add_argument('-o', '--output', default='-',
+                        help='output file (default: stdout)')
+    args = parser.parse_args()
+
+    rings = find_rings(read_input(args.input, args.hex))
+    if not rings:
+        sys.exit('no trace rings found in %s' % args.input)
+
+    freq = max(r[3] for r in rings)
+    records = sorted((rec for r in rings for rec in ring_records(r)),
+                     key=lambda rec: rec[0])
+
+    out = sys.stdout if args.output == '-' else open(args.output, 'w')
+    if args.chrome:
+        print_chrome(records, freq, out)
+    else:
+        print_text(records, freq, out)
+
+
+if __name__ == '__main__':
+    main()